@@ -0,0 +1,25 @@
+//! Inputs shared by the benchmarks
+use ink_stroke_modeler_rs::{ModelerInput, ModelerInputEventType};
+
+/// stroke of `n_inputs` inputs sampled at 240 Hz, from a `Down` to an `Up`, the position
+/// and pressure of the input `i` being `sample(i)`
+pub fn stroke(
+    n_inputs: usize,
+    mut sample: impl FnMut(usize) -> ((f64, f64), f64),
+) -> Vec<ModelerInput> {
+    (0..n_inputs)
+        .map(|i| {
+            let (pos, pressure) = sample(i);
+            ModelerInput {
+                event_type: match i {
+                    0 => ModelerInputEventType::Down,
+                    _ if i == n_inputs - 1 => ModelerInputEventType::Up,
+                    _ => ModelerInputEventType::Move,
+                },
+                pos,
+                time: i as f64 / 240.0,
+                pressure,
+            }
+        })
+        .collect()
+}
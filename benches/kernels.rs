@@ -0,0 +1,43 @@
+//! Modeling throughput for each kernel level supported by the CPU
+//!
+//! Run with `cargo bench --bench kernels`
+use std::time::Instant;
+
+use ink_stroke_modeler_rs::{KernelLevel, ModelerParams, StrokeModeler};
+
+mod common;
+
+fn main() {
+    let inputs = common::stroke(2000, |i| {
+        let pos = (
+            100.0 * (0.02 * i as f64).cos() + 0.3 * (1.7 * i as f64).sin(),
+            100.0 * (0.02 * i as f64).sin(),
+        );
+        (pos, 0.5 + 0.3 * (0.05 * i as f64).sin())
+    });
+    let params = ModelerParams {
+        stylus_state_modeler_max_input_samples: 32,
+        ..ModelerParams::suggested()
+    };
+    for level in KernelLevel::ALL {
+        let mut modeler = StrokeModeler::new(params).unwrap();
+        if modeler.set_kernel_level(level).is_err() {
+            println!("{level:?}: not supported");
+            continue;
+        }
+        let iterations = 50;
+        let mut n_results = 0;
+        let start = Instant::now();
+        for _ in 0..iterations {
+            for input in inputs.iter() {
+                n_results += modeler.update(input.clone()).unwrap().len();
+            }
+        }
+        let elapsed = start.elapsed();
+        println!(
+            "{level:?}: {:.1} ns per input, {:.1} ns per result",
+            elapsed.as_nanos() as f64 / (iterations * inputs.len()) as f64,
+            elapsed.as_nanos() as f64 / n_results as f64,
+        );
+    }
+}
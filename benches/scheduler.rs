@@ -0,0 +1,93 @@
+//! Latency of the local pen under background load, with the priority scheduler
+//! and with all the inputs modeled in arrival order
+//!
+//! Run with `cargo bench --bench scheduler`
+use std::time::{Duration, Instant};
+
+use ink_stroke_modeler_rs::scheduler::{Priority, Scheduler};
+use ink_stroke_modeler_rs::{ModelerInput, ModelerParams, StrokeModeler};
+
+mod common;
+
+/// inputs per frame and per stroke, 240 Hz inputs for 60 Hz frames
+const INPUTS_PER_FRAME: usize = 4;
+const FRAMES: usize = 120;
+
+/// stroke offset by `offset`, which does not end within the frames
+fn stroke(offset: f64) -> Vec<ModelerInput> {
+    common::stroke(FRAMES * INPUTS_PER_FRAME + 1, |i| {
+        let angle = 0.03 * i as f64;
+        ((offset + 50.0 * angle.cos(), 50.0 * angle.sin()), 0.5)
+    })
+}
+
+/// nearest-rank percentile of sorted durations
+fn percentile(sorted: &[Duration], percentile: usize) -> Duration {
+    sorted[(sorted.len() * percentile / 100).min(sorted.len() - 1)]
+}
+
+fn report(name: &str, mut latencies: Vec<Duration>) {
+    latencies.sort();
+    println!(
+        "{name}: p50 {:?}, p99 {:?}, max {:?}",
+        percentile(&latencies, 50),
+        percentile(&latencies, 99),
+        latencies.last().unwrap()
+    );
+}
+
+fn main() {
+    let params = ModelerParams::suggested();
+    let budget = Duration::from_millis(4);
+    for n_background in [0, 100, 400] {
+        // the pen stroke is the first one
+        let strokes: Vec<Vec<ModelerInput>> = (0..n_background.max(1))
+            .map(|index| stroke(index as f64))
+            .collect();
+        // scheduler : the pen is modeled first whatever the load
+        let mut scheduler = Scheduler::new();
+        let pen = scheduler
+            .add_modeler(params, Priority::Interactive)
+            .unwrap();
+        let background: Vec<_> = (0..n_background)
+            .map(|_| scheduler.add_modeler(params, Priority::Background).unwrap())
+            .collect();
+        let mut latencies = Vec::new();
+        for frame in 0..FRAMES {
+            for i in frame * INPUTS_PER_FRAME..(frame + 1) * INPUTS_PER_FRAME {
+                for (index, &id) in background.iter().enumerate() {
+                    scheduler.push(id, strokes[index][i].clone());
+                }
+                scheduler.push(pen, strokes[0][i].clone());
+            }
+            let report = scheduler.run_frame(budget);
+            latencies.push(report.interactive_time);
+        }
+        report(
+            &format!("scheduler, {n_background} background strokes"),
+            latencies,
+        );
+
+        // arrival order : the pen waits for the background inputs queued before it
+        let mut pen = StrokeModeler::new(params).unwrap();
+        let mut background: Vec<StrokeModeler> = (0..n_background)
+            .map(|_| StrokeModeler::new(params).unwrap())
+            .collect();
+        let mut latencies = Vec::new();
+        for frame in 0..FRAMES {
+            let start = Instant::now();
+            for i in frame * INPUTS_PER_FRAME..(frame + 1) * INPUTS_PER_FRAME {
+                for (index, modeler) in background.iter_mut().enumerate() {
+                    modeler.update(strokes[index][i].clone()).unwrap();
+                }
+                pen.update(strokes[0][i].clone()).unwrap();
+            }
+            pen.predict().unwrap();
+            latencies.push(start.elapsed());
+        }
+        report(
+            &format!("arrival order, {n_background} background strokes"),
+            latencies,
+        );
+    }
+}
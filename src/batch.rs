@@ -0,0 +1,557 @@
+//! Remodeling of whole documents
+//!
+//! A [RemodelJob] models a set of strokes with a single [StrokeModeler], in time slices
+//! so that the caller stays responsive :
+//! - [RemodelJob::run_slice] models inputs until its budget is spent and returns, the
+//!   next call resumes where it stopped, in the middle of a stroke if needed
+//! - the strokes are processed in index order unless [RemodelJob::prioritize] moves some
+//!   of them (e.g. the ones visible in the viewport) to the front
+//! - a [CancelHandle] stops the job from another thread, the strokes already remodeled
+//!   stay available
+//!
+//! The strokes are read through the [StrokeBatch] trait, either from one `Vec` of inputs
+//! per stroke or from a [ColumnarStrokes] batch borrowing columns of an existing storage.
+//! The results of all the strokes are written one after the other in a single buffer, see
+//! [RemodelResults], which can be given to the next job to reuse its capacity
+use std::ops::Range;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use crate::{
+    ModelerError, ModelerInput, ModelerInputEventType, ModelerParams, ModelerResult, StrokeModeler,
+};
+
+/// Read access to the raw inputs of a set of strokes
+pub trait StrokeBatch {
+    /// number of strokes
+    fn n_strokes(&self) -> usize;
+    /// number of inputs of the stroke `stroke`
+    fn stroke_len(&self, stroke: usize) -> usize;
+    /// the input `index` of the stroke `stroke`
+    fn input(&self, stroke: usize, index: usize) -> ModelerInput;
+}
+
+impl<T: AsRef<[ModelerInput]>> StrokeBatch for [T] {
+    fn n_strokes(&self) -> usize {
+        self.len()
+    }
+
+    fn stroke_len(&self, stroke: usize) -> usize {
+        self[stroke].as_ref().len()
+    }
+
+    fn input(&self, stroke: usize, index: usize) -> ModelerInput {
+        self[stroke].as_ref()[index].clone()
+    }
+}
+
+impl<T: AsRef<[ModelerInput]>> StrokeBatch for Vec<T> {
+    fn n_strokes(&self) -> usize {
+        self.as_slice().n_strokes()
+    }
+
+    fn stroke_len(&self, stroke: usize) -> usize {
+        self.as_slice().stroke_len(stroke)
+    }
+
+    fn input(&self, stroke: usize, index: usize) -> ModelerInput {
+        self.as_slice().input(stroke, index)
+    }
+}
+
+/// Strokes stored in columns
+///
+/// The inputs of all the strokes are stored one after the other in the `xs`, `ys`, `times`
+/// and `pressures` columns, the stroke `i` being the inputs from `offsets[i]` to
+/// `offsets[i + 1]`. The event types are implied : the first input of a stroke is a `Down`,
+/// the last one an `Up` (unless the stroke has a single input) and the others `Move`s
+#[derive(Debug, Clone, Copy)]
+pub struct ColumnarStrokes<'a> {
+    offsets: &'a [usize],
+    xs: &'a [f64],
+    ys: &'a [f64],
+    times: &'a [f64],
+    pressures: &'a [f64],
+}
+
+impl<'a> ColumnarStrokes<'a> {
+    /// Batch of `offsets.len() - 1` strokes, see [ColumnarStrokes]
+    ///
+    /// The offsets should be increasing and within the columns, the columns of the
+    /// same length
+    pub fn new(
+        offsets: &'a [usize],
+        xs: &'a [f64],
+        ys: &'a [f64],
+        times: &'a [f64],
+        pressures: &'a [f64],
+    ) -> Result<Self, String> {
+        if ys.len() != xs.len() || times.len() != xs.len() || pressures.len() != xs.len() {
+            return Err(String::from("the columns should have the same length"));
+        }
+        if offsets.is_empty() {
+            return Err(String::from(
+                "the offsets should end with the end of the last stroke",
+            ));
+        }
+        if offsets.windows(2).any(|pair| pair[0] > pair[1]) || offsets[offsets.len() - 1] > xs.len()
+        {
+            return Err(String::from(
+                "the offsets should be increasing and within the columns",
+            ));
+        }
+        Ok(Self {
+            offsets,
+            xs,
+            ys,
+            times,
+            pressures,
+        })
+    }
+}
+
+impl<'a> StrokeBatch for ColumnarStrokes<'a> {
+    fn n_strokes(&self) -> usize {
+        self.offsets.len() - 1
+    }
+
+    fn stroke_len(&self, stroke: usize) -> usize {
+        self.offsets[stroke + 1] - self.offsets[stroke]
+    }
+
+    fn input(&self, stroke: usize, index: usize) -> ModelerInput {
+        let row = self.offsets[stroke] + index;
+        ModelerInput {
+            event_type: if index == 0 {
+                ModelerInputEventType::Down
+            } else if row + 1 == self.offsets[stroke + 1] {
+                ModelerInputEventType::Up
+            } else {
+                ModelerInputEventType::Move
+            },
+            pos: (self.xs[row], self.ys[row]),
+            time: self.times[row],
+            pressure: self.pressures[row],
+        }
+    }
+}
+
+/// State of a [RemodelJob] at the end of a slice
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum RemodelStatus {
+    /// strokes remain, call [RemodelJob::run_slice] again
+    InProgress,
+    /// all the strokes are remodeled
+    Done,
+    /// the job was cancelled, the remaining strokes will not be remodeled
+    Cancelled,
+}
+
+/// Reported each time a stroke is remodeled
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct RemodelProgress {
+    /// index of the stroke just remodeled
+    pub stroke: usize,
+    /// number of strokes remodeled so far, including `stroke`
+    pub done: usize,
+    /// number of strokes of the job
+    pub total: usize,
+}
+
+/// Cancels a [RemodelJob], possibly from another thread
+#[derive(Debug, Clone, Default)]
+pub struct CancelHandle(Arc<AtomicBool>);
+
+impl CancelHandle {
+    pub fn cancel(&self) {
+        self.0.store(true, Ordering::Relaxed);
+    }
+
+    pub fn is_cancelled(&self) -> bool {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+/// Results of the strokes remodeled by a [RemodelJob]
+///
+/// The results are stored contiguously, in the order the strokes were remodeled, with the
+/// range of each stroke in the buffer
+#[derive(Debug, Default, PartialEq)]
+pub struct RemodelResults {
+    results: Vec<ModelerResult>,
+    /// range of the results of each stroke, by stroke index, `None` if not remodeled
+    ranges: Vec<Option<Range<usize>>>,
+}
+
+impl RemodelResults {
+    /// Results of the stroke `stroke`, `None` if it is not remodeled
+    pub fn get(&self, stroke: usize) -> Option<&[ModelerResult]> {
+        self.ranges[stroke]
+            .clone()
+            .map(|range| &self.results[range])
+    }
+
+    /// number of strokes
+    pub fn len(&self) -> usize {
+        self.ranges.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.ranges.is_empty()
+    }
+
+    /// results of all the remodeled strokes, in the order they were remodeled
+    pub fn as_slice(&self) -> &[ModelerResult] {
+        &self.results
+    }
+
+    /// range in [RemodelResults::as_slice] of the results of each stroke, by stroke index
+    pub fn ranges(&self) -> &[Option<Range<usize>>] {
+        &self.ranges
+    }
+
+    /// empties the buffers for `n_strokes` strokes, keeping their capacity
+    fn clear(&mut self, n_strokes: usize) {
+        self.results.clear();
+        self.ranges.clear();
+        self.ranges.resize(n_strokes, None);
+    }
+}
+
+/// Resumable remodeling of a set of strokes, see the [module documentation](self)
+pub struct RemodelJob<'a, S: StrokeBatch + ?Sized = [Vec<ModelerInput>]> {
+    strokes: &'a S,
+    modeler: StrokeModeler,
+    /// processing order of the strokes
+    order: Vec<usize>,
+    /// position in `order` of the stroke being remodeled
+    next: usize,
+    /// index of the next input of the stroke being remodeled
+    input_index: usize,
+    /// results of the remodeled strokes, followed by the ones of the stroke in progress
+    results: RemodelResults,
+    /// end of the results of the remodeled strokes in `results`
+    finished_len: usize,
+    errors: Vec<(usize, ModelerError)>,
+    cancel: CancelHandle,
+}
+
+impl<'a, S: StrokeBatch + ?Sized> RemodelJob<'a, S> {
+    /// Job remodeling `strokes` with `params`, each stroke being the raw inputs
+    /// from a `Down` to an `Up`
+    pub fn new(params: ModelerParams, strokes: &'a S) -> Result<Self, String> {
+        Self::with_results(params, strokes, RemodelResults::default())
+    }
+
+    /// Same as [RemodelJob::new], writing the results in the buffers of `results`
+    /// (typically the ones of a previous job) after clearing them
+    pub fn with_results(
+        params: ModelerParams,
+        strokes: &'a S,
+        mut results: RemodelResults,
+    ) -> Result<Self, String> {
+        results.clear(strokes.n_strokes());
+        Ok(Self {
+            strokes,
+            modeler: StrokeModeler::new(params)?,
+            order: (0..strokes.n_strokes()).collect(),
+            next: 0,
+            input_index: 0,
+            results,
+            finished_len: 0,
+            errors: Vec::new(),
+            cancel: CancelHandle::default(),
+        })
+    }
+
+    /// Handle to cancel the job, effective at the next input
+    pub fn cancel_handle(&self) -> CancelHandle {
+        self.cancel.clone()
+    }
+
+    /// Moves the strokes `strokes` to the front of the remaining ones, in this order.
+    /// Strokes already remodeled or in progress are left as they are
+    ///
+    /// Panics if a stroke index is out of range
+    pub fn prioritize(&mut self, strokes: &[usize]) {
+        let in_progress = self.order.get(self.next).filter(|_| self.input_index > 0);
+        let start = self.next + usize::from(in_progress.is_some());
+        let mut first = vec![false; self.results.len()];
+        let mut order = self.order[..start].to_vec();
+        for &stroke in strokes {
+            if self.results.ranges[stroke].is_none()
+                && !first[stroke]
+                && in_progress != Some(&stroke)
+            {
+                first[stroke] = true;
+                order.push(stroke);
+            }
+        }
+        order.extend(
+            self.order[start..]
+                .iter()
+                .copied()
+                .filter(|&stroke| !first[stroke]),
+        );
+        self.order = order;
+    }
+
+    /// Remodels strokes for at most `budget` (checked after each input), calling `progress`
+    /// each time a stroke is finished
+    pub fn run_slice(
+        &mut self,
+        budget: Duration,
+        progress: impl FnMut(RemodelProgress),
+    ) -> RemodelStatus {
+        let start = Instant::now();
+        self.run_slice_with(budget, || start.elapsed(), progress)
+    }
+
+    /// Remodels all the remaining strokes, unless cancelled
+    pub fn run(&mut self, progress: impl FnMut(RemodelProgress)) -> RemodelStatus {
+        self.run_slice_with(Duration::MAX, || Duration::ZERO, progress)
+    }
+
+    /// [RemodelJob::run_slice] with the time spent in the slice given by `elapsed`
+    fn run_slice_with(
+        &mut self,
+        budget: Duration,
+        mut elapsed: impl FnMut() -> Duration,
+        mut progress: impl FnMut(RemodelProgress),
+    ) -> RemodelStatus {
+        while self.next < self.order.len() {
+            if self.cancel.is_cancelled() {
+                return RemodelStatus::Cancelled;
+            }
+            if elapsed() >= budget {
+                return RemodelStatus::InProgress;
+            }
+            let stroke = self.order[self.next];
+            let stroke_len = self.strokes.stroke_len(stroke);
+            if self.input_index == 0 {
+                // a previous stroke may have ended without an `Up` or on an error
+                self.modeler.reset();
+            }
+            let finished = if self.input_index < stroke_len {
+                let input = self.strokes.input(stroke, self.input_index);
+                self.input_index += 1;
+                match self.modeler.update_into(input, &mut self.results.results) {
+                    Ok(()) => self.input_index == stroke_len,
+                    Err(error) => {
+                        // the rest of the stroke is skipped
+                        self.errors.push((stroke, error));
+                        true
+                    }
+                }
+            } else {
+                true
+            };
+            if finished {
+                let end = self.results.results.len();
+                self.results.ranges[stroke] = Some(self.finished_len..end);
+                self.finished_len = end;
+                self.next += 1;
+                self.input_index = 0;
+                progress(RemodelProgress {
+                    stroke,
+                    done: self.next,
+                    total: self.order.len(),
+                });
+            }
+        }
+        RemodelStatus::Done
+    }
+
+    /// number of strokes remodeled so far
+    pub fn done(&self) -> usize {
+        self.next
+    }
+
+    /// Results of the stroke `stroke`, `None` if it is not remodeled yet
+    ///
+    /// The results of a stroke with an error stop at the rejected input
+    pub fn results(&self, stroke: usize) -> Option<&[ModelerResult]> {
+        self.results.get(stroke)
+    }
+
+    /// inputs rejected by the modeler, with the index of their stroke
+    pub fn errors(&self) -> &[(usize, ModelerError)] {
+        &self.errors
+    }
+
+    /// Results of all the remodeled strokes
+    pub fn into_results(mut self) -> RemodelResults {
+        // the stroke in progress is not remodeled
+        self.results.results.truncate(self.finished_len);
+        self.results
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::utils::{test_stroke, ticking_clock};
+
+    fn stroke(offset: f64, n_inputs: usize) -> Vec<ModelerInput> {
+        test_stroke(n_inputs, 0.0, |i| (offset + 0.5 * i as f64, 0.2 * i as f64))
+    }
+
+    #[test]
+    fn slices_match_direct_modeling() {
+        let params = ModelerParams::suggested();
+        let strokes: Vec<Vec<ModelerInput>> = (0..5).map(|i| stroke(10.0 * i as f64, 7)).collect();
+        let mut job = RemodelJob::new(params, &strokes).unwrap();
+        let mut reported = Vec::new();
+        let mut slices = 0;
+        // 3 inputs per slice, strokes are split across slices
+        while job.run_slice_with(Duration::from_millis(4), ticking_clock(), |progress| {
+            reported.push(progress)
+        }) == RemodelStatus::InProgress
+        {
+            slices += 1;
+        }
+        assert_eq!(slices, 11);
+        assert_eq!(reported.len(), 5);
+        assert_eq!(
+            reported[4],
+            RemodelProgress {
+                stroke: 4,
+                done: 5,
+                total: 5
+            }
+        );
+        assert!(job.errors().is_empty());
+
+        let results = job.into_results();
+        assert_eq!(results.len(), 5);
+        for (index, stroke) in strokes.iter().enumerate() {
+            let mut modeler = StrokeModeler::new(params).unwrap();
+            let expected: Vec<ModelerResult> = stroke
+                .iter()
+                .flat_map(|input| modeler.update(input.clone()).unwrap())
+                .collect();
+            assert_eq!(results.get(index).unwrap(), expected);
+        }
+
+        // the buffer of the previous job is reused
+        let previous_len = results.as_slice().len();
+        let pointer = results.as_slice().as_ptr();
+        let mut job = RemodelJob::with_results(params, &strokes[..2], results).unwrap();
+        job.prioritize(&[1]);
+        assert_eq!(job.run(|_| {}), RemodelStatus::Done);
+        let reused = job.into_results();
+        assert_eq!(reused.as_slice().as_ptr(), pointer);
+        assert!(reused.as_slice().len() < previous_len);
+        assert_eq!(reused.len(), 2);
+        // in the order of remodeling
+        let (first, second) = (reused.ranges()[0].clone(), reused.ranges()[1].clone());
+        assert_eq!(second.unwrap().start, 0);
+        assert_eq!(first.unwrap().end, reused.as_slice().len());
+    }
+
+    #[test]
+    fn slow_strokes_match_fresh_modelers() {
+        // below the wobble speed ceiling, so that the wobble smoother state matters
+        let strokes: Vec<Vec<ModelerInput>> = (0..3)
+            .map(|stroke| {
+                test_stroke(20, 0.0, |i| {
+                    let jitter = if i % 2 == 0 { 0.001 } else { -0.001 };
+                    (stroke as f64 + 0.004 * i as f64, jitter)
+                })
+            })
+            .collect();
+        let params = ModelerParams::suggested();
+        let mut job = RemodelJob::new(params, &strokes).unwrap();
+        job.prioritize(&[2, 0]);
+        assert_eq!(job.run(|_| {}), RemodelStatus::Done);
+        for (index, stroke) in strokes.iter().enumerate() {
+            let mut modeler = StrokeModeler::new(params).unwrap();
+            let expected: Vec<ModelerResult> = stroke
+                .iter()
+                .flat_map(|input| modeler.update(input.clone()).unwrap())
+                .collect();
+            assert_eq!(job.results(index).unwrap(), expected);
+        }
+    }
+
+    #[test]
+    fn prioritized_strokes_first() {
+        let strokes: Vec<Vec<ModelerInput>> = (0..6).map(|i| stroke(10.0 * i as f64, 5)).collect();
+        let mut job = RemodelJob::new(ModelerParams::suggested(), &strokes).unwrap();
+        let mut order = Vec::new();
+        // stops in the middle of the stroke 1
+        job.run_slice_with(Duration::from_millis(8), ticking_clock(), |progress| {
+            order.push(progress.stroke)
+        });
+        assert_eq!(order, [0]);
+        // the stroke in progress is finished first, stroke 0 is already done
+        job.prioritize(&[4, 0, 1, 3, 4]);
+        assert_eq!(
+            job.run(|progress| order.push(progress.stroke)),
+            RemodelStatus::Done
+        );
+        assert_eq!(order, [0, 1, 4, 3, 2, 5]);
+    }
+
+    #[test]
+    fn columnar_strokes() {
+        let params = ModelerParams::suggested();
+        let strokes: Vec<Vec<ModelerInput>> = [5, 1, 0, 8]
+            .iter()
+            .enumerate()
+            .map(|(i, &n_inputs)| stroke(10.0 * i as f64, n_inputs))
+            .collect();
+        let mut offsets = vec![0];
+        let (mut xs, mut ys, mut times, mut pressures) = (vec![], vec![], vec![], vec![]);
+        for input in strokes.iter().flatten() {
+            xs.push(input.pos.0);
+            ys.push(input.pos.1);
+            times.push(input.time);
+            pressures.push(input.pressure);
+        }
+        for stroke in &strokes {
+            offsets.push(offsets.last().unwrap() + stroke.len());
+        }
+        let columns = ColumnarStrokes::new(&offsets, &xs, &ys, &times, &pressures).unwrap();
+        for (index, stroke) in strokes.iter().enumerate() {
+            assert_eq!(columns.stroke_len(index), stroke.len());
+            for (i, input) in stroke.iter().enumerate() {
+                assert_eq!(&columns.input(index, i), input);
+            }
+        }
+
+        let mut job = RemodelJob::new(params, &columns).unwrap();
+        assert_eq!(job.run(|_| {}), RemodelStatus::Done);
+        let mut expected = RemodelJob::new(params, &strokes).unwrap();
+        expected.run(|_| {});
+        assert_eq!(job.into_results(), expected.into_results());
+
+        assert!(ColumnarStrokes::new(&offsets, &xs, &ys[1..], &times, &pressures).is_err());
+        assert!(ColumnarStrokes::new(&[0, 3, 2], &xs, &ys, &times, &pressures).is_err());
+        assert!(ColumnarStrokes::new(&[0, 100], &xs, &ys, &times, &pressures).is_err());
+    }
+
+    #[test]
+    fn cancel_and_errors() {
+        let mut strokes: Vec<Vec<ModelerInput>> =
+            (0..4).map(|i| stroke(10.0 * i as f64, 5)).collect();
+        // a `Move` before the `Down`, then a stroke without an `Up`
+        strokes[1].swap(0, 1);
+        strokes[2].pop();
+        let mut job = RemodelJob::new(ModelerParams::suggested(), &strokes).unwrap();
+        let cancel = job.cancel_handle();
+        let status = job.run(|progress| {
+            if progress.stroke == 2 {
+                cancel.cancel();
+            }
+        });
+        assert_eq!(status, RemodelStatus::Cancelled);
+        assert_eq!(job.done(), 3);
+        assert_eq!(job.errors().len(), 1);
+        assert_eq!(job.errors()[0].0, 1);
+        assert_eq!(job.results(1), Some(&[][..]));
+        assert!(!job.results(2).unwrap().is_empty());
+        assert!(job.results(3).is_none());
+    }
+}
@@ -0,0 +1,247 @@
+//! Detection of corners and cusps in the modeled stroke
+//!
+//! The modeled positions round the corners of the raw inputs, so a sharp direction change
+//! is spread over several results. A [CornerDetector] follows the direction of the modeled
+//! velocity and sums the turning over a short arc length window : a turn larger than the
+//! angle threshold within the window is a corner, reported at the result where the
+//! direction changes the most. A turn where the direction reverses between two results
+//! (the pen stops and goes back) is a cusp
+//!
+//! The detection is incremental, see [StrokeModeler::update_with_corners]
+use std::collections::VecDeque;
+
+use crate::ModelerResult;
+#[allow(unused)]
+use crate::StrokeModeler;
+
+/// Kind of a [Corner]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum CornerKind {
+    /// sharp direction change
+    Corner,
+    /// direction reversal
+    Cusp,
+}
+
+/// A corner or cusp of a stroke
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Corner {
+    /// index of the result at the corner, counted from the first result of the stroke
+    pub index: usize,
+    pub kind: CornerKind,
+    /// turning angle of the corner, in radians (positive counterclockwise)
+    pub angle: f64,
+}
+
+/// Finds the corners and cusps of a stroke from its results, see the [module documentation](self)
+#[derive(Debug, Clone)]
+pub struct CornerDetector {
+    angle_threshold: f64,
+    window: f64,
+    /// index of the next result
+    index: usize,
+    /// position and velocity of the last result with a non zero velocity
+    last: Option<((f64, f64), (f64, f64))>,
+    /// arc length since the start of the stroke
+    arc_length: f64,
+    /// direction changes within the window, with the arc length and result index
+    /// where they happened
+    turns: VecDeque<(f64, f64, usize)>,
+    /// sum of the direction changes of `turns`
+    turning: f64,
+    /// the corner being followed, while the turning is above the threshold
+    candidate: Option<Candidate>,
+}
+
+#[derive(Debug, Clone)]
+struct Candidate {
+    corner: Corner,
+    /// largest direction change between two results of the turn
+    max_turn: f64,
+}
+
+/// direction change between two results above which the direction reverses
+const CUSP_TURN: f64 = std::f64::consts::FRAC_PI_2;
+
+impl CornerDetector {
+    /// Detector of the turns larger than `angle_threshold` (in radians) within an arc
+    /// length of `window`
+    ///
+    /// The window should be a few times the distance between two results, and small
+    /// compared to the curvature radius of the strokes
+    pub fn new(angle_threshold: f64, window: f64) -> Result<Self, String> {
+        if angle_threshold.is_nan() || angle_threshold <= 0.0 {
+            return Err(String::from(
+                "the angle threshold should be strictly positive",
+            ));
+        }
+        if window.is_nan() || window <= 0.0 {
+            return Err(String::from("the window should be strictly positive"));
+        }
+        Ok(Self {
+            angle_threshold,
+            window,
+            index: 0,
+            last: None,
+            arc_length: 0.0,
+            turns: VecDeque::new(),
+            turning: 0.0,
+            candidate: None,
+        })
+    }
+
+    /// clears the state of the detector, called when a stroke starts
+    pub fn reset(&mut self) {
+        self.index = 0;
+        self.last = None;
+        self.arc_length = 0.0;
+        self.turns.clear();
+        self.turning = 0.0;
+        self.candidate = None;
+    }
+
+    /// Processes the next result of the stroke, appending the corner it completes to `out`
+    pub fn push(&mut self, result: &ModelerResult, out: &mut Vec<Corner>) {
+        let index = self.index;
+        self.index += 1;
+        if result.velocity == (0.0, 0.0) {
+            return;
+        }
+        let (last_pos, last_velocity) = match self.last.replace((result.pos, result.velocity)) {
+            Some(last) => last,
+            None => return,
+        };
+        self.arc_length += (result.pos.0 - last_pos.0).hypot(result.pos.1 - last_pos.1);
+        let cross = last_velocity.0 * result.velocity.1 - last_velocity.1 * result.velocity.0;
+        let dot = last_velocity.0 * result.velocity.0 + last_velocity.1 * result.velocity.1;
+        let turn = cross.atan2(dot);
+
+        self.turns.push_back((self.arc_length, turn, index));
+        self.turning += turn;
+        while let Some(&(arc_length, turn, _)) = self.turns.front() {
+            if arc_length >= self.arc_length - self.window {
+                break;
+            }
+            self.turning -= turn;
+            self.turns.pop_front();
+        }
+
+        match &mut self.candidate {
+            Some(candidate) => {
+                if turn.abs() > candidate.max_turn {
+                    candidate.max_turn = turn.abs();
+                    candidate.corner.index = index;
+                }
+                if self.turning.abs() > candidate.corner.angle.abs() {
+                    candidate.corner.angle = self.turning;
+                }
+                if turn.abs() > CUSP_TURN {
+                    candidate.corner.kind = CornerKind::Cusp;
+                }
+                // hysteresis, so that the noise around the threshold does not split a corner
+                if self.turning.abs() < 0.5 * self.angle_threshold {
+                    self.finish(out);
+                }
+            }
+            None => {
+                if self.turning.abs() >= self.angle_threshold {
+                    // the largest direction change of the window
+                    let (max_turn, max_index) = self
+                        .turns
+                        .iter()
+                        .map(|&(_, turn, index)| (turn.abs(), index))
+                        .fold((0.0, index), |max, el| if el.0 > max.0 { el } else { max });
+                    let kind = if max_turn > CUSP_TURN {
+                        CornerKind::Cusp
+                    } else {
+                        CornerKind::Corner
+                    };
+                    self.candidate = Some(Candidate {
+                        corner: Corner {
+                            index: max_index,
+                            kind,
+                            angle: self.turning,
+                        },
+                        max_turn,
+                    });
+                }
+            }
+        }
+    }
+
+    /// Appends the corner in progress to `out`, called when the stroke ends
+    pub fn finish(&mut self, out: &mut Vec<Corner>) {
+        if let Some(candidate) = self.candidate.take() {
+            out.push(candidate.corner);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::utils::test_stroke;
+    use crate::ModelerParams;
+
+    /// models the raw positions (about 1 apart) sampled at 240 Hz,
+    /// returns the results and corners
+    fn model(positions: &[(f64, f64)]) -> (Vec<ModelerResult>, Vec<Corner>) {
+        let mut modeler = StrokeModeler::new(ModelerParams::suggested()).unwrap();
+        let mut detector = CornerDetector::new(std::f64::consts::FRAC_PI_3, 6.0).unwrap();
+        let mut results = Vec::new();
+        let mut corners = Vec::new();
+        for input in test_stroke(positions.len(), 0.0, |i| positions[i]) {
+            results.extend(
+                modeler
+                    .update_with_corners(input, &mut detector, &mut corners)
+                    .unwrap(),
+            );
+        }
+        (results, corners)
+    }
+
+    #[test]
+    fn right_angle() {
+        let positions: Vec<(f64, f64)> = (0..30)
+            .map(|i| (i as f64, 0.0))
+            .chain((1..30).map(|i| (29.0, i as f64)))
+            .collect();
+        let (results, corners) = model(&positions);
+        assert_eq!(corners.len(), 1);
+        assert_eq!(corners[0].kind, CornerKind::Corner);
+        assert!((corners[0].angle - std::f64::consts::FRAC_PI_2).abs() < 0.3);
+        let pos = results[corners[0].index].pos;
+        assert!((pos.0 - 29.0).abs() < 2.0 && pos.1.abs() < 2.0);
+    }
+
+    #[test]
+    fn reversal_is_a_cusp() {
+        let positions: Vec<(f64, f64)> = (0..30)
+            .map(|i| (i as f64, 0.0))
+            .chain((1..30).map(|i| (29.0 - i as f64, 0.1 * i as f64)))
+            .collect();
+        let (results, corners) = model(&positions);
+        assert_eq!(corners.len(), 1);
+        assert_eq!(corners[0].kind, CornerKind::Cusp);
+        // at the apex of the modeled stroke, which lags behind the raw one
+        let apex = results
+            .iter()
+            .map(|result| result.pos.0)
+            .fold(0.0, f64::max);
+        assert!((results[corners[0].index].pos.0 - apex).abs() < 0.5);
+    }
+
+    #[test]
+    fn smooth_curves_have_no_corners() {
+        let line: Vec<(f64, f64)> = (0..60).map(|i| (i as f64, 0.5 * i as f64)).collect();
+        assert!(model(&line).1.is_empty());
+        let arc: Vec<(f64, f64)> = (0..120)
+            .map(|i| {
+                let angle = 0.02 * i as f64;
+                (100.0 * angle.cos(), 100.0 * angle.sin())
+            })
+            .collect();
+        assert!(model(&arc).1.is_empty());
+        assert!(CornerDetector::new(0.0, 1.0).is_err());
+    }
+}
@@ -0,0 +1,112 @@
+//! Decimation of the modeled positions
+//!
+//! With [StrokeModeler::update_decimated], a [Decimator] selects the modeled positions
+//! to keep before their pressure is interpolated, so that the pressure lookups are only
+//! done for the surviving positions
+use crate::utils::dist;
+
+// only imported for docstrings
+#[allow(unused)]
+use crate::StrokeModeler;
+
+/// Selects the modeled positions to keep, in order
+///
+/// The first and last positions of a stroke are always kept, so that the decimated
+/// ink starts and ends where the pen did. The decimator still sees them
+pub trait Decimator {
+    /// whether to keep the modeled position `pos` at `time`
+    fn keep(&mut self, pos: (f64, f64), time: f64) -> bool;
+
+    /// clears the state of the decimator, called when a stroke starts
+    fn reset(&mut self) {}
+}
+
+impl<F: FnMut((f64, f64), f64) -> bool> Decimator for F {
+    fn keep(&mut self, pos: (f64, f64), time: f64) -> bool {
+        self(pos, time)
+    }
+}
+
+/// Arc-length spacing : keeps a position if it is at least `spacing` away from
+/// the last kept one
+#[derive(Debug, Clone)]
+pub struct MinDistance {
+    spacing: f64,
+    last: Option<(f64, f64)>,
+}
+
+impl MinDistance {
+    pub fn new(spacing: f64) -> Self {
+        Self {
+            spacing,
+            last: None,
+        }
+    }
+}
+
+impl Decimator for MinDistance {
+    fn keep(&mut self, pos: (f64, f64), _time: f64) -> bool {
+        if self
+            .last
+            .map_or(false, |last| dist(last, pos) < self.spacing)
+        {
+            return false;
+        }
+        self.last = Some(pos);
+        true
+    }
+
+    fn reset(&mut self) {
+        self.last = None;
+    }
+}
+
+/// Frame sync : keeps a position if it is at least `period` later than
+/// the last kept one, e.g. one position per displayed frame
+#[derive(Debug, Clone)]
+pub struct MinPeriod {
+    period: f64,
+    last: Option<f64>,
+}
+
+impl MinPeriod {
+    pub fn new(period: f64) -> Self {
+        Self { period, last: None }
+    }
+}
+
+impl Decimator for MinPeriod {
+    fn keep(&mut self, _pos: (f64, f64), time: f64) -> bool {
+        if self.last.map_or(false, |last| time - last < self.period) {
+            return false;
+        }
+        self.last = Some(time);
+        true
+    }
+
+    fn reset(&mut self) {
+        self.last = None;
+    }
+}
+
+#[test]
+fn min_distance_spacing() {
+    let mut decimator = MinDistance::new(1.0);
+    let kept: Vec<bool> = [0.0, 0.5, 1.0, 1.9, 2.0, 3.5]
+        .iter()
+        .map(|&x| decimator.keep((x, 0.0), 0.0))
+        .collect();
+    assert_eq!(kept, [true, false, true, false, true, true]);
+    decimator.reset();
+    assert!(decimator.keep((3.6, 0.0), 0.0));
+}
+
+#[test]
+fn min_period_frame_sync() {
+    let mut decimator = MinPeriod::new(0.01);
+    let kept: Vec<bool> = [0.0, 0.004, 0.008, 0.012, 0.016, 0.025]
+        .iter()
+        .map(|&time| decimator.keep((0.0, 0.0), time))
+        .collect();
+    assert_eq!(kept, [true, false, false, true, false, true]);
+}
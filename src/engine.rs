@@ -1,11 +1,16 @@
+use crate::corners::{Corner, CornerDetector};
+use crate::decimation::Decimator;
 use crate::error::{ElementError, ElementOrderError};
+use crate::kernels::{KernelLevel, Kernels};
 use crate::position_modeler::PositionModeler;
+use crate::results::{LocalModelerResult, ModelerPartial, StrokeOrigin};
+use crate::ring_buffer::RingBuffer;
+use crate::spike_filter::SpikeFilter;
 use crate::state_modeler::StateModeler;
 use crate::utils::interp;
 use crate::utils::normalize01_64;
 use crate::{ModelerError, ModelerInput, ModelerInputEventType, ModelerParams, ModelerResult};
-use std::collections::VecDeque;
-use std::vec;
+use allocator_api2::alloc::{Allocator, Global};
 
 /// smooth out the input position from high frequency noise
 /// uses a moving average of position and interpolating between this
@@ -28,6 +33,19 @@ pub(crate) struct WobbleSample {
     pub time: f64,
 }
 
+/// Additional output of the modeler, with its own position modeling and
+/// resampling parameters, fed by the input validation, wobble smoothing and
+/// stylus state stages of the modeler it is attached to
+pub(crate) struct SecondaryOutput {
+    /// parameters of the output, only the position modeling
+    /// and sampling parameters are used
+    pub(crate) params: ModelerParams,
+    /// physical model for the output, created on the Down event
+    pub(crate) position_modeler: Option<PositionModeler>,
+    /// results generated during the current call
+    pub(crate) results: Vec<ModelerResult>,
+}
+
 /// This class models a stroke from a raw input stream. The modeling is performed in
 /// several stages
 /// - Wobble smoothing : dampens high-frequency noise from quantization error
@@ -38,14 +56,31 @@ pub(crate) struct WobbleSample {
 ///
 /// Additional, this class provides prediction of the modeled stroke
 ///
+/// Several outputs can be modeled from the same input stream (e.g. a low quality preview
+/// and a high quality final stroke) with [StrokeModeler::add_output], in which case the
+/// input validation, wobble smoothing and stylus state stages are only done once
+///
+/// Optionally, a spike filter rejects isolated position spikes before the wobble smoothing
+/// (see [ModelerParams::spike_filter_max_acceleration])
+///
+/// The modeling is done in a stroke-local frame, relative to the position and time of the
+/// `Down` event (see [StrokeOrigin]), and results are converted back to canvas coordinates.
+/// [StrokeModeler::update_local] and [StrokeModeler::predict_local] return the stroke-local
+/// results in single precision instead
+///
 /// StrokeModeler is unit-agnostic
-pub struct StrokeModeler {
+///
+/// The internal buffers are allocated with the allocator `A` (the global allocator by default,
+/// see [StrokeModeler::new_in] for other allocators). They are reused between strokes, so that
+/// once warmed up, the modeler itself does not allocate anymore. The results can be returned
+/// in a per-call allocator with [StrokeModeler::update_in] and [StrokeModeler::predict_in]
+pub struct StrokeModeler<A: Allocator + Clone = Global> {
     // all configuration parameters
     pub(crate) params: ModelerParams,
     /// wobble smoother structures
     /// deque to hold events that are recent
     /// to calculate a moving average
-    pub(crate) wobble_deque: VecDeque<WobbleSample>,
+    pub(crate) wobble_deque: RingBuffer<WobbleSample, A>,
     /// running weighted sum
     pub(crate) wobble_weighted_pos_sum: (f64, f64),
     /// running duration sum
@@ -57,27 +92,33 @@ pub struct StrokeModeler {
     pub(crate) position_modeler: Option<PositionModeler>,
     pub(crate) last_event: Option<ModelerInput>,
     pub(crate) last_corrected_event: Option<(f64, f64)>,
-    pub(crate) state_modeler: StateModeler,
+    /// origin of the stroke-local frame of the current (or last) stroke
+    pub(crate) origin: StrokeOrigin,
+    pub(crate) state_modeler: StateModeler<A>,
+    /// additional outputs sharing the stages up to the position modeling
+    pub(crate) secondary_outputs: Vec<SecondaryOutput>,
+    /// outlier rejection ahead of the wobble smoothing, if enabled
+    pub(crate) spike_filter: Option<SpikeFilter>,
+    /// scratch buffer holding the positions modeled during a call
+    /// before their pressure is queried
+    pub(crate) partial_buffer: allocator_api2::vec::Vec<ModelerPartial, A>,
+    /// positions modeled by the last prediction, before their pressure is queried
+    pub(crate) prediction_tail: allocator_api2::vec::Vec<ModelerPartial, A>,
+    /// anchor of `prediction_tail`, `None` once an input has been modeled since
+    pub(crate) prediction_anchor: Option<(f64, f64)>,
+    /// allocator used for the internal buffers
+    pub(crate) alloc: A,
 }
 
 impl Default for StrokeModeler {
     fn default() -> Self {
-        let params = ModelerParams::suggested();
-
-        Self {
-            params,
-            wobble_deque: VecDeque::with_capacity(
-                (2.0 * params.sampling_min_output_rate * params.wobble_smoother_timeout) as usize,
-            ),
-            wobble_weighted_pos_sum: (0.0, 0.0),
-            wobble_duration_sum: 0.0,
-            wobble_distance_sum: 0.0,
+        Self::with_params_in(ModelerParams::suggested(), Global)
+    }
+}
 
-            last_event: None,
-            last_corrected_event: None,
-            position_modeler: None,
-            state_modeler: StateModeler::new(params.stylus_state_modeler_max_input_samples),
-        }
+impl StrokeModeler {
+    pub fn new(params: ModelerParams) -> Result<Self, String> {
+        Self::new_in(params, Global)
     }
 }
 
@@ -86,22 +127,62 @@ impl Default for StrokeModeler {
 #[doc = include_str!("../docs/position_modeling.html")]
 #[doc = include_str!("../docs/stylus_state_modeler.html")]
 #[doc = include_str!("../docs/stroke_end.html")]
-impl StrokeModeler {
-    pub fn new(params: ModelerParams) -> Result<Self, String> {
+impl<A: Allocator + Clone> StrokeModeler<A> {
+    /// Creates a modeler whose internal buffers are allocated in `alloc`
+    pub fn new_in(params: ModelerParams, alloc: A) -> Result<Self, String> {
         params.validate()?;
-        Ok(Self {
+        Ok(Self::with_params_in(params, alloc))
+    }
+
+    /// construct the modeler without validating the parameters
+    fn with_params_in(params: ModelerParams, alloc: A) -> Self {
+        Self {
             params,
             last_event: None,
             last_corrected_event: None,
-            wobble_deque: VecDeque::with_capacity(
-                (2.0 * params.sampling_min_output_rate * params.wobble_smoother_timeout) as usize,
+            origin: StrokeOrigin::default(),
+            wobble_deque: RingBuffer::with_capacity_in(
+                Self::wobble_capacity(&params),
+                alloc.clone(),
             ),
             wobble_duration_sum: 0.0,
             wobble_weighted_pos_sum: (0.0, 0.0),
             wobble_distance_sum: 0.0,
             position_modeler: None,
-            state_modeler: StateModeler::new(params.stylus_state_modeler_max_input_samples),
-        })
+            state_modeler: {
+                let mut state_modeler = StateModeler::new_in(
+                    params.stylus_state_modeler_max_input_samples,
+                    alloc.clone(),
+                );
+                state_modeler.set_horizon(
+                    params.stylus_state_modeler_max_input_duration,
+                    params.stylus_state_modeler_max_input_distance,
+                );
+                state_modeler
+            },
+            secondary_outputs: Vec::new(),
+            spike_filter: params.spike_filter_max_acceleration.map(SpikeFilter::new),
+            partial_buffer: allocator_api2::vec::Vec::with_capacity_in(
+                Self::partial_capacity(&params),
+                alloc.clone(),
+            ),
+            prediction_tail: allocator_api2::vec::Vec::with_capacity_in(
+                params.sampling_end_of_stroke_max_iterations,
+                alloc.clone(),
+            ),
+            prediction_anchor: None,
+            alloc,
+        }
+    }
+
+    /// expected number of elements in the wobble deque
+    fn wobble_capacity(params: &ModelerParams) -> usize {
+        (2.0 * params.sampling_min_output_rate * params.wobble_smoother_timeout) as usize
+    }
+
+    /// maximum number of positions modeled during a single call
+    fn partial_capacity(params: &ModelerParams) -> usize {
+        params.sampling_max_outputs_per_call + params.sampling_end_of_stroke_max_iterations
     }
 
     /// Clears any in-progress stroke, keeping the same model parameters
@@ -109,21 +190,28 @@ impl StrokeModeler {
         self.wobble_deque.clear();
         self.wobble_weighted_pos_sum = (0.0, 0.0);
         self.wobble_duration_sum = 0.0;
+        self.wobble_distance_sum = 0.0;
         self.position_modeler = None;
         self.last_event = None;
         self.last_corrected_event = None;
         self.state_modeler
             .reset(self.params.stylus_state_modeler_max_input_samples);
+        self.prediction_anchor = None;
+        if let Some(spike_filter) = self.spike_filter.as_mut() {
+            spike_filter.reset();
+        }
+        self.reset_secondary_outputs();
     }
 
     /// Clears any in-progress stroke, and re initialize the model with
     /// the given parameters
+    ///
+    /// Secondary outputs are kept with their own parameters
     pub fn reset_w_params(&mut self, params: ModelerParams) -> Result<(), String> {
         params.validate()?;
         self.params = params;
-        self.wobble_deque = VecDeque::with_capacity(
-            (2.0 * params.sampling_min_output_rate * params.wobble_smoother_timeout) as usize,
-        );
+        self.wobble_deque =
+            RingBuffer::with_capacity_in(Self::wobble_capacity(&params), self.alloc.clone());
         self.wobble_weighted_pos_sum = (0.0, 0.0);
         self.wobble_duration_sum = 0.0;
         self.wobble_distance_sum = 0.0;
@@ -132,17 +220,344 @@ impl StrokeModeler {
         self.last_corrected_event = None;
         self.state_modeler
             .reset(params.stylus_state_modeler_max_input_samples);
+        self.state_modeler.set_horizon(
+            params.stylus_state_modeler_max_input_duration,
+            params.stylus_state_modeler_max_input_distance,
+        );
+        self.spike_filter = params.spike_filter_max_acceleration.map(SpikeFilter::new);
+        self.reset_secondary_outputs();
+        self.partial_buffer = allocator_api2::vec::Vec::with_capacity_in(
+            Self::partial_capacity(&params),
+            self.alloc.clone(),
+        );
+        self.prediction_anchor = None;
+        Ok(())
+    }
+
+    /// Adds an output modeled from the same input stream, with the position modeling and sampling
+    /// parameters of `params` (the other parameters are the ones of the modeler).
+    /// Returns the index of the output for [StrokeModeler::update_outputs] and
+    /// [StrokeModeler::predict_output], the primary output having index 0
+    ///
+    /// Returns an error if the parameters are invalid or if a stroke is in progress
+    pub fn add_output(&mut self, params: ModelerParams) -> Result<usize, String> {
+        params.validate()?;
+        if self.last_event.is_some() {
+            return Err(String::from(
+                "outputs can't be added while a stroke is in progress",
+            ));
+        }
+        self.secondary_outputs.push(SecondaryOutput {
+            params,
+            position_modeler: None,
+            results: Vec::new(),
+        });
+        Ok(self.secondary_outputs.len())
+    }
+
+    /// The instruction set used by the kernels of the modeler, selected from the CPU
+    /// features when the modeler is constructed (see [KernelLevel::detect])
+    pub fn kernel_level(&self) -> KernelLevel {
+        self.state_modeler.kernels().level()
+    }
+
+    /// Forces the instruction set used by the kernels, typically [KernelLevel::Scalar]
+    /// for testing and benchmarks
+    ///
+    /// Returns an error if the CPU does not support `level`
+    pub fn set_kernel_level(&mut self, level: KernelLevel) -> Result<(), String> {
+        let kernels = Kernels::new(level)
+            .ok_or_else(|| format!("{level:?} kernels are not supported by this CPU"))?;
+        self.state_modeler.set_kernels(kernels);
         Ok(())
     }
 
+    /// Removes all secondary outputs
+    pub fn clear_outputs(&mut self) {
+        self.secondary_outputs.clear();
+    }
+
+    fn reset_secondary_outputs(&mut self) {
+        for output in self.secondary_outputs.iter_mut() {
+            output.position_modeler = None;
+            output.results.clear();
+        }
+    }
+
     /// Updates the model with a raw input, and appends newly generated Results to the results vector.
     /// Any previously generated Result values remain valid.
     /// (This does not require that any previous results returned remain in the results vector, as it is
     /// appended to without examining the existing contents)
     ///
     /// If this does not return an error, results will contain at least one Result, and potentially
-    /// more if the inputs are slower than the minimum output rate
+    /// more if the inputs are slower than the minimum output rate.
+    /// The exception is a `Move` input held back by the spike filter, for which results are only
+    /// generated on the next input
+    ///
+    /// When secondary outputs were added, they are updated as well but their
+    /// results are discarded, use [StrokeModeler::update_outputs] to get them
     pub fn update(&mut self, input: ModelerInput) -> Result<Vec<ModelerResult>, ModelerError> {
+        let mut results = Vec::new();
+        self.update_into(input, &mut results)?;
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::update], returning the results of every output,
+    /// indexed as returned by [StrokeModeler::add_output]
+    pub fn update_outputs(
+        &mut self,
+        input: ModelerInput,
+    ) -> Result<Vec<Vec<ModelerResult>>, ModelerError> {
+        let mut results = Vec::with_capacity(1 + self.secondary_outputs.len());
+        results.push(Vec::new());
+        self.update_into(input, &mut results[0])?;
+        let origin = self.origin;
+        results.extend(self.secondary_outputs.iter_mut().map(|output| {
+            output
+                .results
+                .drain(..)
+                .map(|result| origin.to_canvas(result))
+                .collect()
+        }));
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::update], with the results allocated in `alloc`
+    pub fn update_in<B: Allocator>(
+        &mut self,
+        input: ModelerInput,
+        alloc: B,
+    ) -> Result<allocator_api2::vec::Vec<ModelerResult, B>, ModelerError> {
+        let mut results = allocator_api2::vec::Vec::new_in(alloc);
+        self.update_into(input, &mut results)?;
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::update], with the results in the stroke-local frame
+    /// (relative to [StrokeModeler::stroke_origin]) and in single precision
+    pub fn update_local(
+        &mut self,
+        input: ModelerInput,
+    ) -> Result<Vec<LocalModelerResult>, ModelerError> {
+        let mut results = Vec::new();
+        let input = self.start_local(input);
+        self.update_local_into(
+            input,
+            &mut keep_all,
+            &mut MapResults {
+                out: &mut results,
+                map: LocalModelerResult::from,
+            },
+        )?;
+        Ok(results)
+    }
+
+    /// The origin of the stroke-local frame of the current (or last) stroke,
+    /// `None` if no stroke was started
+    pub fn stroke_origin(&self) -> Option<StrokeOrigin> {
+        self.position_modeler.as_ref().map(|_| self.origin)
+    }
+
+    /// Updates the model with a raw input and appends the newly generated results to `out`
+    pub(crate) fn update_into(
+        &mut self,
+        input: ModelerInput,
+        out: &mut impl Extend<ModelerResult>,
+    ) -> Result<(), ModelerError> {
+        let input = self.start_local(input);
+        let origin = self.origin;
+        self.update_local_into(
+            input,
+            &mut keep_all,
+            &mut MapResults {
+                out,
+                map: |result| origin.to_canvas(result),
+            },
+        )
+    }
+
+    /// Same as [StrokeModeler::update], keeping only the modeled positions selected by
+    /// `decimator`. The pressure is only interpolated for the kept positions
+    ///
+    /// Secondary outputs are not decimated
+    pub fn update_decimated(
+        &mut self,
+        input: ModelerInput,
+        decimator: &mut impl Decimator,
+    ) -> Result<Vec<ModelerResult>, ModelerError> {
+        let mut results = Vec::new();
+        if input.event_type == ModelerInputEventType::Down && self.last_event.is_none() {
+            decimator.reset();
+        }
+        let input = self.start_local(input);
+        let origin = self.origin;
+        self.update_local_into(
+            input,
+            &mut |partial: &ModelerPartial| {
+                decimator.keep(
+                    (partial.pos.0 + origin.pos.0, partial.pos.1 + origin.pos.1),
+                    partial.time + origin.time,
+                )
+            },
+            &mut MapResults {
+                out: &mut results,
+                map: |result| origin.to_canvas(result),
+            },
+        )?;
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::update], also appending to `corners` the corners and cusps
+    /// that `detector` finds in the results of the stroke
+    ///
+    /// A corner is found once the turn is over, its [Corner::index] can refer to a result
+    /// returned by a previous call. Predictions are not searched for corners
+    pub fn update_with_corners(
+        &mut self,
+        input: ModelerInput,
+        detector: &mut CornerDetector,
+        corners: &mut Vec<Corner>,
+    ) -> Result<Vec<ModelerResult>, ModelerError> {
+        let mut results = Vec::new();
+        if input.event_type == ModelerInputEventType::Down && self.last_event.is_none() {
+            detector.reset();
+        }
+        let is_up = input.event_type == ModelerInputEventType::Up;
+        let input = self.start_local(input);
+        let origin = self.origin;
+        self.update_local_into(
+            input,
+            &mut keep_all,
+            &mut MapResults {
+                out: &mut results,
+                map: |result| {
+                    detector.push(&result, corners);
+                    origin.to_canvas(result)
+                },
+            },
+        )?;
+        if is_up {
+            detector.finish(corners);
+        }
+        Ok(results)
+    }
+
+    /// convert the raw input to the stroke-local frame, a `Down` event
+    /// starting a stroke sets the origin of the frame
+    fn start_local(&mut self, input: ModelerInput) -> ModelerInput {
+        if input.event_type == ModelerInputEventType::Down && self.last_event.is_none() {
+            let origin = StrokeOrigin {
+                pos: input.pos,
+                time: input.time,
+            };
+            self.move_wobble_samples(origin);
+            self.origin = origin;
+        }
+        self.origin.to_local(input)
+    }
+
+    /// the wobble smoother samples outlive the stroke, move them from the frame
+    /// of the previous stroke to the frame of `origin`
+    fn move_wobble_samples(&mut self, origin: StrokeOrigin) {
+        let shift = (
+            origin.pos.0 - self.origin.pos.0,
+            origin.pos.1 - self.origin.pos.1,
+        );
+        let time_shift = origin.time - self.origin.time;
+        for index in 0..self.wobble_deque.len() {
+            let sample = self.wobble_deque.get_mut(index).unwrap();
+            sample.position = (sample.position.0 - shift.0, sample.position.1 - shift.1);
+            sample.weighted_position = (
+                sample.position.0 * sample.duration,
+                sample.position.1 * sample.duration,
+            );
+            sample.time -= time_shift;
+        }
+        self.wobble_weighted_pos_sum = (
+            self.wobble_weighted_pos_sum.0 - shift.0 * self.wobble_duration_sum,
+            self.wobble_weighted_pos_sum.1 - shift.1 * self.wobble_duration_sum,
+        );
+    }
+
+    /// Updates the model with a raw input in the stroke-local frame and appends
+    /// the newly generated results (in the same frame) that `keep` selects to `out`
+    fn update_local_into(
+        &mut self,
+        input: ModelerInput,
+        keep: &mut impl FnMut(&ModelerPartial) -> bool,
+        out: &mut impl Extend<ModelerResult>,
+    ) -> Result<(), ModelerError> {
+        for output in self.secondary_outputs.iter_mut() {
+            output.results.clear();
+        }
+        self.filter_input(input, keep, out)
+    }
+
+    /// Passes the raw input through the spike filter (if enabled) and models it
+    fn filter_input(
+        &mut self,
+        input: ModelerInput,
+        keep: &mut impl FnMut(&ModelerPartial) -> bool,
+        out: &mut impl Extend<ModelerResult>,
+    ) -> Result<(), ModelerError> {
+        if self.spike_filter.is_none() {
+            return self.model_input(input, keep, out);
+        }
+        // inputs that would be rejected by the modeler are passed through
+        // so that the error is reported right away
+        let is_valid_move = input.event_type == ModelerInputEventType::Move
+            && self.last_event.as_ref().map_or(false, |last| {
+                input.time > last.time && !self.too_far_apart(input.time - last.time)
+            });
+        let spike_filter = self.spike_filter.as_mut().unwrap();
+
+        match spike_filter.held.take() {
+            None => {
+                if is_valid_move && !spike_filter.is_plausible(&input) {
+                    spike_filter.held = Some(input);
+                    return Ok(());
+                }
+                self.model_input(input, keep, out)
+            }
+            Some(held) => {
+                if input.event_type == ModelerInputEventType::Down {
+                    spike_filter.held = Some(held);
+                    return self.model_input(input, keep, out);
+                }
+                if input.time < held.time {
+                    spike_filter.held = Some(held);
+                    return Err(ModelerError::Element {
+                        src: ElementError::NegativeTimeDelta,
+                    });
+                }
+                if input == held {
+                    spike_filter.held = Some(held);
+                    return Err(ModelerError::Element {
+                        src: ElementError::Duplicate,
+                    });
+                }
+
+                if spike_filter.is_plausible(&input) {
+                    // the held input was an isolated spike, drop it
+                    self.model_input(input, keep, out)
+                } else {
+                    // the new input confirms the jump, the held input is genuine
+                    self.model_input(held, keep, out)?;
+                    self.filter_input(input, keep, out)
+                }
+            }
+        }
+    }
+
+    /// Models a raw input and appends the newly generated results to `out`
+    fn model_input(
+        &mut self,
+        input: ModelerInput,
+        keep: &mut impl FnMut(&ModelerPartial) -> bool,
+        out: &mut impl Extend<ModelerResult>,
+    ) -> Result<(), ModelerError> {
+        // the last prediction is only valid until the model changes
+        let prediction_anchor = self.prediction_anchor.take();
         match input.event_type {
             ModelerInputEventType::Down => {
                 if self.last_event.is_some() {
@@ -161,13 +576,32 @@ impl StrokeModeler {
                 self.state_modeler
                     .reset(self.params.stylus_state_modeler_max_input_samples);
                 self.state_modeler.update(input.clone());
-                Ok(vec![ModelerResult {
+                if let Some(spike_filter) = self.spike_filter.as_mut() {
+                    spike_filter.reset();
+                    spike_filter.accept(&input);
+                }
+                let result = || ModelerResult {
                     pos: input.pos,
                     velocity: (0.0, 0.0),
                     acceleration: (0.0, 0.0),
                     time: input.time,
                     pressure: input.pressure,
-                }])
+                };
+                let first = ModelerPartial {
+                    pos: input.pos,
+                    velocity: (0.0, 0.0),
+                    acceleration: (0.0, 0.0),
+                    time: input.time,
+                };
+                // the first position of the stroke is always kept, `keep` still sees it
+                let _ = keep(&first);
+                out.extend(Some(result()));
+                for output in self.secondary_outputs.iter_mut() {
+                    output.position_modeler =
+                        Some(PositionModeler::new(output.params, input.clone()));
+                    output.results.push(result());
+                }
+                Ok(())
             }
             ModelerInputEventType::Move => {
                 // get the latest element
@@ -194,15 +628,21 @@ impl StrokeModeler {
                     });
                 }
 
-                self.state_modeler.update(input.clone());
-
-                // calculate the number of element to predict
-                let n_steps =
-                    ((new_time - latest_time) * self.params.sampling_min_output_rate).ceil() as i32;
+                // the pressures are queried at positions lagging behind the input
+                let modeled = self
+                    .position_modeler
+                    .iter()
+                    .chain(
+                        self.secondary_outputs
+                            .iter()
+                            .filter_map(|output| output.position_modeler.as_ref()),
+                    )
+                    .map(|modeler| modeler.state.pos);
+                self.state_modeler.update_behind(input.clone(), modeled);
 
                 // this errors if the number of steps is larger than
-                // [ModelParams::sampling_max_outputs_per_call]
-                if n_steps as usize > self.params.sampling_max_outputs_per_call {
+                // [ModelParams::sampling_max_outputs_per_call] (for any output)
+                if self.too_far_apart(new_time - latest_time) {
                     return Err(ModelerError::Element {
                         src: ElementError::TooFarApart,
                     });
@@ -212,26 +652,48 @@ impl StrokeModeler {
                 let p_end = self.wobble_update(&input);
                 // seems like speeds are way higher than normal speed encountered so no smoothing occurs here
 
-                let vec_out: Vec<ModelerResult> = self
-                    .position_modeler
+                self.position_modeler
                     .as_mut()
                     .unwrap()
-                    .update_along_linear_path(p_start, latest_time, p_end, new_time, n_steps)
-                    .into_iter()
-                    .map(|i| ModelerResult {
-                        pressure: self.state_modeler.query(i.pos),
-                        pos: i.pos,
-                        velocity: i.velocity,
-                        acceleration: i.acceleration,
-                        time: i.time,
-                    })
-                    .collect();
+                    .update_along_linear_path(
+                        p_start,
+                        latest_time,
+                        p_end,
+                        new_time,
+                        resampling_steps(&self.params, new_time - latest_time),
+                        &mut self.partial_buffer,
+                    );
+                query_pressures(&mut self.state_modeler, &mut self.partial_buffer, keep, out);
+
+                for output in self.secondary_outputs.iter_mut() {
+                    output
+                        .position_modeler
+                        .as_mut()
+                        .unwrap()
+                        .update_along_linear_path(
+                            p_start,
+                            latest_time,
+                            p_end,
+                            new_time,
+                            resampling_steps(&output.params, new_time - latest_time),
+                            &mut self.partial_buffer,
+                        );
+                    query_pressures(
+                        &mut self.state_modeler,
+                        &mut self.partial_buffer,
+                        &mut keep_all,
+                        &mut output.results,
+                    );
+                }
 
                 // push the latest element (should we push everything we also interpolated as well ?)
                 self.last_event = Some(input.clone());
                 self.last_corrected_event = Some(p_end);
+                if let Some(spike_filter) = self.spike_filter.as_mut() {
+                    spike_filter.accept(&input);
+                }
 
-                Ok(vec_out)
+                Ok(())
             }
             ModelerInputEventType::Up => {
                 // get the latest element
@@ -257,15 +719,21 @@ impl StrokeModeler {
                     });
                 }
 
-                self.state_modeler.update(input.clone());
-
-                // calculate the number of element to predict
-                let n_tsteps =
-                    ((new_time - latest_time) * self.params.sampling_min_output_rate).ceil() as i32;
+                // the pressures are queried at positions lagging behind the input
+                let modeled = self
+                    .position_modeler
+                    .iter()
+                    .chain(
+                        self.secondary_outputs
+                            .iter()
+                            .filter_map(|output| output.position_modeler.as_ref()),
+                    )
+                    .map(|modeler| modeler.state.pos);
+                self.state_modeler.update_behind(input.clone(), modeled);
 
                 // this errors if the number of steps is larger than
-                // [ModelParams::sampling_max_outputs_per_call]
-                if n_tsteps as usize > self.params.sampling_max_outputs_per_call {
+                // [ModelParams::sampling_max_outputs_per_call] (for any output)
+                if self.too_far_apart(new_time - latest_time) {
                     return Err(ModelerError::Element {
                         src: ElementError::TooFarApart,
                     });
@@ -278,68 +746,58 @@ impl StrokeModeler {
                 // behavior between the predict on a Move and a Up
                 let p_end = self.wobble_update(&input);
 
-                let mut vec_out = Vec::<ModelerResult>::with_capacity(
-                    (n_tsteps as usize) + self.params.sampling_end_of_stroke_max_iterations,
-                );
-
-                vec_out.extend(
-                    self.position_modeler
-                        .as_mut()
-                        .unwrap()
-                        .update_along_linear_path(p_start, latest_time, p_end, new_time, n_tsteps)
-                        .into_iter()
-                        .map(|i| ModelerResult {
-                            pressure: self.state_modeler.query(i.pos),
-                            pos: i.pos,
-                            velocity: i.velocity,
-                            time: i.time,
-                            acceleration: i.acceleration,
-                        }),
+                // an Up that does not move ends the stroke with the last prediction,
+                // which is already modeled
+                let tail = if new_time == latest_time && prediction_anchor == Some(input.pos) {
+                    Some(&self.prediction_tail[..])
+                } else {
+                    None
+                };
+                model_last_segment(
+                    self.position_modeler.as_mut().unwrap(),
+                    &self.params,
+                    (p_start, latest_time),
+                    (p_end, new_time),
+                    input.pos,
+                    tail,
+                    &mut self.partial_buffer,
                 );
-
-                // model the end of stroke
-                vec_out.extend(
-                    self.position_modeler
-                        .as_mut()
-                        .unwrap()
-                        .model_end_of_stroke(
-                            input.pos,
-                            1. / self.params.sampling_min_output_rate,
-                            self.params.sampling_end_of_stroke_max_iterations,
-                            self.params.sampling_end_of_stroke_stopping_distance,
-                        )
-                        .into_iter()
-                        .map(|i| ModelerResult {
-                            pressure: self.state_modeler.query(i.pos),
-                            pos: i.pos,
-                            velocity: i.velocity,
-                            acceleration: i.acceleration,
-                            time: i.time,
-                        }),
+                // the last position of the stroke is always kept, `keep` still sees it
+                let n_partials = self.partial_buffer.len();
+                let mut index = 0;
+                let mut keep_last = |partial: &ModelerPartial| {
+                    index += 1;
+                    keep(partial) || index == n_partials
+                };
+                query_pressures(
+                    &mut self.state_modeler,
+                    &mut self.partial_buffer,
+                    &mut keep_last,
+                    out,
                 );
 
-                if vec_out.is_empty() {
-                    let state_pos = self.position_modeler.as_ref().unwrap().state.clone();
-                    vec_out.push(ModelerResult {
-                        pos: state_pos.pos,
-                        velocity: state_pos.velocity,
-                        acceleration: state_pos.acceleration,
-                        // this is so that the extra stroke added has a time that's larger than the previous one
-                        // when the Up happens at the same time as the Move
-                        // In the original implementation, this was always true because
-                        // the ModelEndOfStroke function did not restore the state of the modeler
-                        // so that even if a single candidate was tried and iterations stopped there
-                        // the status of the modeler changed, including the time by at least
-                        // `1. / self.params.sampling_min_output_rate`
-                        time: state_pos.time + 1. / self.params.sampling_min_output_rate,
-                        pressure: self.state_modeler.query(state_pos.pos),
-                    });
+                for output in self.secondary_outputs.iter_mut() {
+                    model_last_segment(
+                        output.position_modeler.as_mut().unwrap(),
+                        &output.params,
+                        (p_start, latest_time),
+                        (p_end, new_time),
+                        input.pos,
+                        None,
+                        &mut self.partial_buffer,
+                    );
+                    query_pressures(
+                        &mut self.state_modeler,
+                        &mut self.partial_buffer,
+                        &mut keep_all,
+                        &mut output.results,
+                    );
                 }
 
                 // remove the last event
                 self.last_event = None;
 
-                Ok(vec_out)
+                Ok(())
             }
         }
     }
@@ -349,34 +807,132 @@ impl StrokeModeler {
     /// Returns an error if the model has not yet been initialized,
     /// if there is no stroke in progress
     pub fn predict(&mut self) -> Result<Vec<ModelerResult>, String> {
+        let mut results = Vec::new();
+        self.predict_into(&mut results)?;
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::predict], with the results allocated in `alloc`
+    ///
+    /// As predictions are discarded on the next input, this is typically used with
+    /// a per-frame arena allocator that is freed in bulk
+    pub fn predict_in<B: Allocator>(
+        &mut self,
+        alloc: B,
+    ) -> Result<allocator_api2::vec::Vec<ModelerResult, B>, String> {
+        let mut results = allocator_api2::vec::Vec::new_in(alloc);
+        self.predict_into(&mut results)?;
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::predict], with the results in the stroke-local frame
+    /// (relative to [StrokeModeler::stroke_origin]) and in single precision
+    pub fn predict_local(&mut self) -> Result<Vec<LocalModelerResult>, String> {
+        let mut results = Vec::new();
+        self.predict_local_into(&mut MapResults {
+            out: &mut results,
+            map: LocalModelerResult::from,
+        })?;
+        Ok(results)
+    }
+
+    /// Same as [StrokeModeler::predict], for the output of index `output`
+    /// as returned by [StrokeModeler::add_output]
+    ///
+    /// Returns an error if there is no stroke in progress or no output of this index
+    pub fn predict_output(&mut self, output: usize) -> Result<Vec<ModelerResult>, String> {
+        let mut results = Vec::new();
+        match output {
+            0 => self.predict_into(&mut results)?,
+            _ => {
+                if output > self.secondary_outputs.len() {
+                    return Err(format!("no output of index {output}"));
+                }
+                if self.last_event.is_none() {
+                    return Err(String::from("empty input events"));
+                }
+                let secondary = &mut self.secondary_outputs[output - 1];
+                secondary
+                    .position_modeler
+                    .as_mut()
+                    .unwrap()
+                    .model_end_of_stroke(
+                        self.last_event.as_ref().unwrap().pos,
+                        1. / secondary.params.sampling_min_output_rate,
+                        secondary.params.sampling_end_of_stroke_max_iterations,
+                        secondary.params.sampling_end_of_stroke_stopping_distance,
+                        &mut self.partial_buffer,
+                    );
+                let origin = self.origin;
+                query_pressures(
+                    &mut self.state_modeler,
+                    &mut self.partial_buffer,
+                    &mut keep_all,
+                    &mut MapResults {
+                        out: &mut results,
+                        map: |result| origin.to_canvas(result),
+                    },
+                );
+            }
+        }
+        Ok(results)
+    }
+
+    /// Models the prediction and appends it to `out`
+    pub(crate) fn predict_into(
+        &mut self,
+        out: &mut impl Extend<ModelerResult>,
+    ) -> Result<(), String> {
+        let origin = self.origin;
+        self.predict_local_into(&mut MapResults {
+            out,
+            map: |result| origin.to_canvas(result),
+        })
+    }
+
+    /// Models the prediction in the stroke-local frame and appends it to `out`
+    fn predict_local_into(&mut self, out: &mut impl Extend<ModelerResult>) -> Result<(), String> {
         // for now return the latest element if it exists from the input
         if self.last_event.is_none() {
             // no data to predict from
             Err(String::from("empty input events"))
         } else {
-            // construct the prediction (model_end_of_stroke does not modify the position modeler)
-            let predict = self
-                .position_modeler
-                .as_mut()
-                .unwrap()
-                .model_end_of_stroke(
-                    self.last_event.as_ref().unwrap().pos,
+            let anchor = self.last_event.as_ref().unwrap().pos;
+            // no input was modeled since the last prediction, its positions are reused
+            if self.prediction_anchor != Some(anchor) {
+                // construct the prediction (model_end_of_stroke does not modify the position modeler)
+                self.prediction_tail.clear();
+                self.position_modeler.as_mut().unwrap().model_end_of_stroke(
+                    anchor,
                     1. / self.params.sampling_min_output_rate,
                     self.params.sampling_end_of_stroke_max_iterations,
                     self.params.sampling_end_of_stroke_stopping_distance,
-                )
-                .into_iter()
-                .map(|i| ModelerResult {
-                    pos: i.pos,
-                    velocity: i.velocity,
-                    acceleration: i.acceleration,
-                    time: i.time,
-                    pressure: self.state_modeler.query(i.pos),
-                })
-                .collect();
-            Ok(predict)
+                    &mut self.prediction_tail,
+                );
+                self.prediction_anchor = Some(anchor);
+            }
+            self.partial_buffer
+                .extend(self.prediction_tail.iter().cloned());
+            query_pressures(
+                &mut self.state_modeler,
+                &mut self.partial_buffer,
+                &mut keep_all,
+                out,
+            );
+            Ok(())
         }
     }
+
+    /// whether inputs `delta_time` apart would generate more than
+    /// [ModelerParams::sampling_max_outputs_per_call] results for any output
+    fn too_far_apart(&self, delta_time: f64) -> bool {
+        std::iter::once(&self.params)
+            .chain(self.secondary_outputs.iter().map(|output| &output.params))
+            .any(|params| {
+                resampling_steps(params, delta_time) as usize > params.sampling_max_outputs_per_call
+            })
+    }
+
     ///implements the wobble logic
     ///smoothes out the input position from high frequency noise
     ///uses a moving average of position and interpolating between this
@@ -456,6 +1012,104 @@ impl StrokeModeler {
     }
 }
 
+/// keeps all the modeled positions
+fn keep_all(_: &ModelerPartial) -> bool {
+    true
+}
+
+/// Applies `map` to the results before appending them to `out`
+struct MapResults<'a, E, F> {
+    out: &'a mut E,
+    map: F,
+}
+
+impl<'a, T, E: Extend<T>, F: FnMut(ModelerResult) -> T> Extend<ModelerResult>
+    for MapResults<'a, E, F>
+{
+    fn extend<I: IntoIterator<Item = ModelerResult>>(&mut self, iter: I) {
+        self.out.extend(iter.into_iter().map(&mut self.map));
+    }
+}
+
+/// number of modeled positions between two inputs `delta_time` apart
+fn resampling_steps(params: &ModelerParams, delta_time: f64) -> i32 {
+    (delta_time * params.sampling_min_output_rate).ceil() as i32
+}
+
+/// models the last segment of the stroke then the catch-up to the final raw position,
+/// appending the modeled positions to `partials`
+///
+/// `tail` is the catch-up when it is already modeled, by a prediction from the same state
+/// and anchor. At least one position is generated
+fn model_last_segment<A: Allocator>(
+    position_modeler: &mut PositionModeler,
+    params: &ModelerParams,
+    (p_start, start_time): ((f64, f64), f64),
+    (p_end, end_time): ((f64, f64), f64),
+    raw_end: (f64, f64),
+    tail: Option<&[ModelerPartial]>,
+    partials: &mut allocator_api2::vec::Vec<ModelerPartial, A>,
+) {
+    let initial_len = partials.len();
+    position_modeler.update_along_linear_path(
+        p_start,
+        start_time,
+        p_end,
+        end_time,
+        resampling_steps(params, end_time - start_time),
+        partials,
+    );
+
+    // model the end of stroke
+    match tail {
+        Some(tail) => partials.extend(tail.iter().cloned()),
+        None => position_modeler.model_end_of_stroke(
+            raw_end,
+            1. / params.sampling_min_output_rate,
+            params.sampling_end_of_stroke_max_iterations,
+            params.sampling_end_of_stroke_stopping_distance,
+            partials,
+        ),
+    }
+
+    if partials.len() == initial_len {
+        let state = position_modeler.state.clone();
+        partials.push(ModelerPartial {
+            // this is so that the extra stroke added has a time that's larger than the previous one
+            // when the Up happens at the same time as the Move
+            // In the original implementation, this was always true because
+            // the ModelEndOfStroke function did not restore the state of the modeler
+            // so that even if a single candidate was tried and iterations stopped there
+            // the status of the modeler changed, including the time by at least
+            // `1. / params.sampling_min_output_rate`
+            time: state.time + 1. / params.sampling_min_output_rate,
+            ..state
+        });
+    }
+}
+
+/// query the pressure of the modeled positions held in `partials` that `keep` selects
+/// and move them as results to `out`, the other ones are discarded
+fn query_pressures<A: Allocator + Clone, B: Allocator>(
+    state_modeler: &mut StateModeler<A>,
+    partials: &mut allocator_api2::vec::Vec<ModelerPartial, B>,
+    keep: &mut impl FnMut(&ModelerPartial) -> bool,
+    out: &mut impl Extend<ModelerResult>,
+) {
+    out.extend(
+        partials
+            .drain(..)
+            .filter(|i| keep(i))
+            .map(|i| ModelerResult {
+                pressure: state_modeler.query(i.pos),
+                pos: i.pos,
+                velocity: i.velocity,
+                acceleration: i.acceleration,
+                time: i.time,
+            }),
+    );
+}
+
 #[cfg(test)]
 mod tests {
 
@@ -2773,4 +3427,400 @@ mod tests {
         });
         assert!(res4.is_err());
     }
+
+    /// allocator counting the number of allocations made through it
+    struct CountingAllocator {
+        allocations: std::cell::Cell<usize>,
+    }
+
+    unsafe impl allocator_api2::alloc::Allocator for CountingAllocator {
+        fn allocate(
+            &self,
+            layout: std::alloc::Layout,
+        ) -> Result<std::ptr::NonNull<[u8]>, allocator_api2::alloc::AllocError> {
+            self.allocations.set(self.allocations.get() + 1);
+            allocator_api2::alloc::Global.allocate(layout)
+        }
+
+        unsafe fn deallocate(&self, ptr: std::ptr::NonNull<u8>, layout: std::alloc::Layout) {
+            allocator_api2::alloc::Global.deallocate(ptr, layout)
+        }
+    }
+
+    #[test]
+    fn allocator_aware_outputs() {
+        let modeler_alloc = CountingAllocator {
+            allocations: std::cell::Cell::new(0),
+        };
+        let frame_alloc = CountingAllocator {
+            allocations: std::cell::Cell::new(0),
+        };
+        let mut engine = StrokeModeler::new_in(ModelerParams::suggested(), &modeler_alloc).unwrap();
+        let mut reference = StrokeModeler::default();
+        let construction_allocations = modeler_alloc.allocations.get();
+
+        let inputs = (0..10).map(|i| ModelerInput {
+            event_type: match i {
+                0 => ModelerInputEventType::Down,
+                9 => ModelerInputEventType::Up,
+                _ => ModelerInputEventType::Move,
+            },
+            pos: (i as f64, (i as f64).sqrt()),
+            time: i as f64 * 0.01,
+            pressure: 0.5,
+        });
+        for input in inputs {
+            let results = engine.update_in(input.clone(), &frame_alloc).unwrap();
+            assert_eq!(
+                results.as_slice(),
+                reference.update(input).unwrap().as_slice()
+            );
+            if engine.last_event.is_some() {
+                let prediction = engine.predict_in(&frame_alloc).unwrap();
+                assert_eq!(
+                    prediction.as_slice(),
+                    reference.predict().unwrap().as_slice()
+                );
+            }
+        }
+
+        // the internal buffers are sized at construction, outputs only use the frame allocator
+        assert_eq!(modeler_alloc.allocations.get(), construction_allocations);
+        assert!(frame_alloc.allocations.get() > 0);
+    }
+
+    /// straight stroke at constant speed, with the positions of `replaced` samples overridden
+    fn straight_stroke(replaced: &[(usize, (f64, f64))]) -> Vec<ModelerInput> {
+        (0..12)
+            .map(|i| ModelerInput {
+                event_type: match i {
+                    0 => ModelerInputEventType::Down,
+                    11 => ModelerInputEventType::Up,
+                    _ => ModelerInputEventType::Move,
+                },
+                pos: replaced
+                    .iter()
+                    .find(|(index, _)| *index == i)
+                    .map_or((0.1 * i as f64, 0.0), |(_, pos)| *pos),
+                time: 0.01 * i as f64,
+                pressure: 0.5,
+            })
+            .collect()
+    }
+
+    fn model_stroke(params: ModelerParams, inputs: Vec<ModelerInput>) -> Vec<ModelerResult> {
+        let mut engine = StrokeModeler::new(params).unwrap();
+        inputs
+            .into_iter()
+            .flat_map(|input| engine.update(input).unwrap())
+            .collect()
+    }
+
+    #[test]
+    fn spike_filter_rejects_spike() {
+        let params = ModelerParams {
+            spike_filter_max_acceleration: Some(1e4),
+            ..ModelerParams::suggested()
+        };
+        let mut clean = straight_stroke(&[]);
+        clean.remove(5);
+        let spiky = straight_stroke(&[(5, (50.0, 50.0))]);
+
+        // the spike is held back then dropped
+        let mut engine = StrokeModeler::new(params).unwrap();
+        for input in spiky.iter().take(5) {
+            assert!(!engine.update(input.clone()).unwrap().is_empty());
+        }
+        assert!(engine.update(spiky[5].clone()).unwrap().is_empty());
+        assert!(engine.spike_filter.as_ref().unwrap().held.is_some());
+
+        assert_eq!(
+            model_stroke(params, spiky.clone()),
+            model_stroke(params, clean)
+        );
+        // disabled filter
+        assert_ne!(
+            model_stroke(ModelerParams::suggested(), spiky.clone()),
+            model_stroke(params, spiky)
+        );
+    }
+
+    #[test]
+    fn spike_filter_keeps_confirmed_jump() {
+        let params = ModelerParams {
+            spike_filter_max_acceleration: Some(1e4),
+            ..ModelerParams::suggested()
+        };
+        // the stroke jumps by 5 at the 5th sample and continues from there
+        let jump: Vec<(usize, (f64, f64))> =
+            (5..12).map(|i| (i, (5.0 + 0.1 * i as f64, 0.0))).collect();
+        let inputs = straight_stroke(&jump);
+
+        assert_eq!(
+            model_stroke(params, inputs.clone()),
+            model_stroke(ModelerParams::suggested(), inputs)
+        );
+    }
+
+    #[test]
+    fn secondary_outputs_match_separate_modelers() {
+        let preview_params = ModelerParams {
+            sampling_min_output_rate: 60.0,
+            sampling_end_of_stroke_max_iterations: 5,
+            ..ModelerParams::suggested()
+        };
+        let mut engine = StrokeModeler::default();
+        assert_eq!(engine.add_output(preview_params), Ok(1));
+        let mut primary = StrokeModeler::default();
+        let mut preview = StrokeModeler::new(preview_params).unwrap();
+
+        for input in straight_stroke(&[(4, (0.5, 0.3)), (7, (0.6, 0.2))]) {
+            let is_up = input.event_type == ModelerInputEventType::Up;
+            let results = engine.update_outputs(input.clone()).unwrap();
+            assert_eq!(results.len(), 2);
+            assert_eq!(results[0], primary.update(input.clone()).unwrap());
+            assert_eq!(results[1], preview.update(input).unwrap());
+            if !is_up {
+                assert_eq!(engine.predict_output(0), primary.predict());
+                assert_eq!(engine.predict_output(1), preview.predict());
+            }
+        }
+        assert!(engine.predict_output(2).is_err());
+    }
+
+    #[test]
+    fn add_output_during_stroke() {
+        let mut engine = StrokeModeler::default();
+        engine.update(ModelerInput::default()).unwrap();
+        assert!(engine.add_output(ModelerParams::suggested()).is_err());
+        engine.reset();
+        assert!(engine.add_output(ModelerParams::suggested()).is_ok());
+        engine.clear_outputs();
+        assert_eq!(
+            engine
+                .update_outputs(ModelerInput::default())
+                .unwrap()
+                .len(),
+            1
+        );
+    }
+
+    #[test]
+    fn stroke_local_frame() {
+        let offset = (1e9, -1e9);
+        let far: Vec<ModelerInput> = straight_stroke(&[(4, (0.5, 0.3))])
+            .into_iter()
+            .map(|input| ModelerInput {
+                pos: (input.pos.0 + offset.0, input.pos.1 + offset.1),
+                time: input.time + 1e6,
+                ..input
+            })
+            .collect();
+
+        // the precision is kept far from the canvas origin
+        let near = model_stroke(
+            ModelerParams::suggested(),
+            straight_stroke(&[(4, (0.5, 0.3))]),
+        );
+        let far_results = model_stroke(ModelerParams::suggested(), far.clone());
+        assert_eq!(near.len(), far_results.len());
+        for (near, far) in near.iter().zip(far_results.iter()) {
+            approx::assert_abs_diff_eq!(near.pos.0 + offset.0, far.pos.0, epsilon = 1e-6);
+            approx::assert_abs_diff_eq!(near.pos.1 + offset.1, far.pos.1, epsilon = 1e-6);
+            // the far inputs themselves are only representable to ~1e-7
+            approx::assert_abs_diff_eq!(near.velocity.0, far.velocity.0, epsilon = 1e-4);
+            approx::assert_abs_diff_eq!(near.velocity.1, far.velocity.1, epsilon = 1e-4);
+        }
+
+        // local results are relative to the origin of the stroke
+        let mut engine = StrokeModeler::default();
+        assert_eq!(engine.stroke_origin(), None);
+        let local: Vec<LocalModelerResult> = far
+            .iter()
+            .flat_map(|input| engine.update_local(input.clone()).unwrap())
+            .collect();
+        assert_eq!(
+            engine.stroke_origin(),
+            Some(StrokeOrigin {
+                pos: far[0].pos,
+                time: far[0].time,
+            })
+        );
+        assert_eq!(local.len(), near.len());
+        for (local, near) in local.iter().zip(near.iter()) {
+            approx::assert_abs_diff_eq!(local.pos.0, near.pos.0 as f32, epsilon = 1e-5);
+            approx::assert_abs_diff_eq!(local.pos.1, near.pos.1 as f32, epsilon = 1e-5);
+            approx::assert_abs_diff_eq!(local.time, near.time as f32, epsilon = 1e-5);
+            approx::assert_abs_diff_eq!(local.pressure, near.pressure as f32);
+        }
+    }
+
+    #[test]
+    fn consecutive_strokes_frame() {
+        let mut engine = StrokeModeler::default();
+        for input in straight_stroke(&[]) {
+            engine.update(input).unwrap();
+        }
+        let down = ModelerInput {
+            pos: (5.0, 5.0),
+            time: 1.0,
+            ..ModelerInput::default()
+        };
+        engine.update(down).unwrap();
+        // the samples of the first stroke are older than the wobble timeout
+        // once expressed in the frame of the second stroke
+        assert_eq!(engine.wobble_deque.len(), 1);
+        let sample = engine.wobble_deque.front().unwrap();
+        assert_eq!(sample.position, (0.0, 0.0));
+        approx::assert_abs_diff_eq!(sample.duration, 0.89, epsilon = 1e-12);
+        approx::assert_abs_diff_eq!(engine.wobble_weighted_pos_sum.0, 0.0, epsilon = 1e-12);
+    }
+
+    #[test]
+    fn forced_scalar_kernels() {
+        let stroke = straight_stroke(&[(4, (0.5, 0.3)), (7, (0.6, 0.2))]);
+        let mut detected = StrokeModeler::default();
+        let mut scalar = StrokeModeler::default();
+        scalar.set_kernel_level(KernelLevel::Scalar).unwrap();
+        assert_eq!(scalar.kernel_level(), KernelLevel::Scalar);
+        for input in stroke {
+            assert_eq!(
+                detected.update(input.clone()).unwrap(),
+                scalar.update(input).unwrap()
+            );
+        }
+        for level in KernelLevel::ALL {
+            assert_eq!(scalar.set_kernel_level(level).is_ok(), level.is_supported());
+        }
+    }
+
+    #[test]
+    fn up_reuses_prediction() {
+        let mut stroke = straight_stroke(&[(4, (0.5, 0.3))]);
+        // the Up does not move
+        stroke[11] = ModelerInput {
+            event_type: ModelerInputEventType::Up,
+            ..stroke[10].clone()
+        };
+        let mut predicting = StrokeModeler::default();
+        let mut reference = StrokeModeler::default();
+        for input in stroke {
+            let is_up = input.event_type == ModelerInputEventType::Up;
+            if is_up {
+                assert!(predicting.prediction_anchor.is_some());
+            }
+            assert_eq!(
+                predicting.update(input.clone()).unwrap(),
+                reference.update(input).unwrap()
+            );
+            if !is_up {
+                let prediction = predicting.predict().unwrap();
+                // repeated predictions reuse the modeled positions
+                assert_eq!(predicting.predict().unwrap(), prediction);
+            }
+        }
+        assert!(predicting.prediction_anchor.is_none());
+    }
+
+    #[test]
+    fn decimated_update() {
+        use crate::decimation::{Decimator, MinDistance};
+
+        let stroke = straight_stroke(&[(4, (0.5, 0.3)), (7, (0.6, 0.2))]);
+        for spacing in [0.05, 0.3] {
+            let mut full = StrokeModeler::default();
+            let mut decimated = StrokeModeler::default();
+            // the same decimation applied after the fact
+            let mut reference = MinDistance::new(spacing);
+            let mut decimator = MinDistance::new(spacing);
+            for _ in 0..2 {
+                reference.reset();
+                let (mut n_full, mut n_decimated) = (0, 0);
+                let (mut full_end, mut decimated_end) = (None, None);
+                for input in stroke.iter() {
+                    let results = full.update(input.clone()).unwrap();
+                    n_full += results.len();
+                    // the end of the stroke is always kept
+                    let last = match input.event_type {
+                        ModelerInputEventType::Up => results.len().checked_sub(1),
+                        _ => None,
+                    };
+                    let expected: Vec<ModelerResult> = results
+                        .into_iter()
+                        .enumerate()
+                        .filter(|(index, result)| {
+                            reference.keep(result.pos, result.time) | (Some(*index) == last)
+                        })
+                        .map(|(_, result)| result)
+                        .collect();
+                    let mut results = decimated
+                        .update_decimated(input.clone(), &mut decimator)
+                        .unwrap();
+                    n_decimated += results.len();
+                    assert_eq!(results, expected);
+                    if last.is_some() {
+                        full_end = expected.last().map(|result| result.pos);
+                        decimated_end = results.pop().map(|result| result.pos);
+                    }
+                }
+                assert!(n_decimated < n_full);
+                // the decimated stroke ends where the full one does, at the Up position
+                assert_eq!(decimated_end, full_end);
+                let up = stroke.last().unwrap().pos;
+                let end = decimated_end.unwrap();
+                assert!(crate::utils::dist(end, up) < 0.01);
+            }
+        }
+    }
+
+    #[test]
+    fn state_modeler_horizon() {
+        // 1000 Hz inputs along a line, with a varying pressure
+        let inputs: Vec<ModelerInput> = (0..400)
+            .map(|i| ModelerInput {
+                event_type: match i {
+                    0 => ModelerInputEventType::Down,
+                    399 => ModelerInputEventType::Up,
+                    _ => ModelerInputEventType::Move,
+                },
+                pos: (0.2 * i as f64, 0.1 * i as f64),
+                time: 0.001 * i as f64,
+                pressure: 0.5 + 0.4 * (0.03 * i as f64).sin(),
+            })
+            .collect();
+        let by_count = ModelerParams {
+            stylus_state_modeler_max_input_samples: 200,
+            ..ModelerParams::suggested()
+        };
+        let by_time = ModelerParams {
+            stylus_state_modeler_max_input_duration: Some(0.1),
+            ..by_count
+        };
+        let by_distance = ModelerParams {
+            stylus_state_modeler_max_input_distance: Some(20.0),
+            ..by_count
+        };
+        // the horizons are counted from the modeled positions, which lag about 0.025
+        // behind the inputs : even horizons shorter than the lag keep the nearest inputs
+        let expected = model_stroke(by_count, inputs.clone());
+        assert_eq!(model_stroke(by_time, inputs.clone()), expected);
+        assert_eq!(model_stroke(by_distance, inputs.clone()), expected);
+        let short_horizons = [(Some(0.005), None), (None, Some(1.0))];
+        for (max_duration, max_distance) in short_horizons {
+            let params = ModelerParams {
+                stylus_state_modeler_max_input_duration: max_duration,
+                stylus_state_modeler_max_input_distance: max_distance,
+                ..by_count
+            };
+            assert_eq!(model_stroke(params, inputs.clone()), expected);
+        }
+
+        let mut engine = StrokeModeler::new(by_time).unwrap();
+        for input in inputs.into_iter().take(300) {
+            engine.update(input).unwrap();
+        }
+        // 0.1 behind the lagging modeled position
+        let len = engine.state_modeler.xs.len();
+        assert!((110..150).contains(&len));
+    }
 }
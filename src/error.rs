@@ -34,4 +34,6 @@ pub enum ModelerError {
         #[from]
         src: ElementError,
     },
+    #[error("Input record with an invalid event type")]
+    InvalidRecord,
 }
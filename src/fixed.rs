@@ -0,0 +1,922 @@
+//! Fixed-point implementation of the modeler, for targets without a FPU
+//!
+//! [FixedStrokeModeler] reproduces the wobble smoother, the spring-mass integrator and the
+//! pressure interpolation of [StrokeModeler] with integer arithmetic only. Values are
+//! `i64` with a number of fractional bits given by a [FixedFormat] (Q format). Floating
+//! point is only used once, when converting the [ModelerParams] to [FixedParams], which
+//! can also be built directly from their fixed-point values.
+//!
+//! With the [FixedFormat::suggested] formats, results stay within `1e-3` of the float
+//! modeler for positions and pressures (see the `cross_check` test). Prediction is not
+//! implemented.
+//!
+//! Like the float modeler, the modeling is done in a stroke-local frame, relative to the
+//! position and time of the `Down` event. Unlike it, the wobble smoother starts anew with
+//! each stroke, so the first results of a stroke can differ.
+//!
+//! The products and quotients are computed on `i128` and the values stored on `i64`. For
+//! any format, positions (in the input unit) should stay within `2^(48 - position_bits)`
+//! of the `Down` position of their stroke (the accelerations are a few thousand times
+//! these distances), absolute positions below `2^(62 - position_bits)` and times below
+//! `2^(62 - time_bits)`. With the suggested formats, that is `2^32`, `2^46` and `2^38`
+use crate::error::{ElementError, ElementOrderError, ModelerError};
+use crate::ring_buffer::RingBuffer;
+use crate::{ModelerInput, ModelerInputEventType, ModelerParams, ModelerResult};
+
+// only imported for docstrings
+#[allow(unused)]
+use crate::StrokeModeler;
+
+/// Number of fractional bits of the fixed-point values
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FixedFormat {
+    /// positions, velocities, accelerations and distances
+    pub position_bits: u32,
+    /// times and durations
+    pub time_bits: u32,
+    /// pressures, interpolation ratios and model coefficients
+    pub unit_bits: u32,
+}
+
+impl FixedFormat {
+    /// [FixedFormat::position_bits] : 16,\
+    /// [FixedFormat::time_bits] : 24,\
+    /// [FixedFormat::unit_bits] : 16
+    pub fn suggested() -> Self {
+        Self {
+            position_bits: 16,
+            time_bits: 24,
+            unit_bits: 16,
+        }
+    }
+
+    fn validate(self) -> Result<Self, String> {
+        let valid = |bits: u32| (1..=30).contains(&bits);
+        if valid(self.position_bits) && valid(self.time_bits) && valid(self.unit_bits) {
+            Ok(self)
+        } else {
+            Err(String::from(
+                "the number of fractional bits should be between 1 and 30",
+            ))
+        }
+    }
+
+    /// convert a float input to the fixed-point formats
+    pub fn input(&self, input: &ModelerInput) -> FixedInput {
+        FixedInput {
+            event_type: input.event_type,
+            pos: (
+                to_fixed(input.pos.0, self.position_bits),
+                to_fixed(input.pos.1, self.position_bits),
+            ),
+            time: to_fixed(input.time, self.time_bits),
+            pressure: to_fixed(input.pressure, self.unit_bits),
+        }
+    }
+
+    /// convert a fixed-point result to floats
+    pub fn result(&self, result: &FixedResult) -> ModelerResult {
+        let position = |value: i64| from_fixed(value, self.position_bits);
+        ModelerResult {
+            pos: (position(result.pos.0), position(result.pos.1)),
+            velocity: (position(result.velocity.0), position(result.velocity.1)),
+            acceleration: (
+                position(result.acceleration.0),
+                position(result.acceleration.1),
+            ),
+            time: from_fixed(result.time, self.time_bits),
+            pressure: from_fixed(result.pressure, self.unit_bits),
+        }
+    }
+}
+
+/// [ModelerInput] in fixed point
+///
+/// `pos` is in the position format, `time` in the time format and `pressure` in the unit format
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FixedInput {
+    pub event_type: ModelerInputEventType,
+    pub pos: (i64, i64),
+    pub time: i64,
+    pub pressure: i64,
+}
+
+/// [ModelerResult] in fixed point
+///
+/// `pos`, `velocity` and `acceleration` are in the position format, `time` in the time format
+/// and `pressure` in the unit format
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct FixedResult {
+    pub pos: (i64, i64),
+    pub velocity: (i64, i64),
+    pub acceleration: (i64, i64),
+    pub time: i64,
+    pub pressure: i64,
+}
+
+/// The parameters of the modeler used by [FixedStrokeModeler], in fixed point
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FixedParams {
+    pub format: FixedFormat,
+    /// [ModelerParams::wobble_smoother_timeout], time format
+    pub wobble_smoother_timeout: i64,
+    /// [ModelerParams::wobble_smoother_speed_floor], position format
+    pub wobble_smoother_speed_floor: i64,
+    /// [ModelerParams::wobble_smoother_speed_ceiling], position format
+    pub wobble_smoother_speed_ceiling: i64,
+    /// inverse of [ModelerParams::position_modeler_spring_mass_constant], unit format
+    pub position_modeler_inverse_spring_mass_constant: i64,
+    /// [ModelerParams::position_modeler_drag_constant], unit format
+    pub position_modeler_drag_constant: i64,
+    /// [ModelerParams::sampling_min_output_rate], unit format
+    pub sampling_min_output_rate: i64,
+    /// [ModelerParams::sampling_end_of_stroke_stopping_distance], position format
+    pub sampling_end_of_stroke_stopping_distance: i64,
+    pub sampling_end_of_stroke_max_iterations: usize,
+    pub sampling_max_outputs_per_call: usize,
+    pub stylus_state_modeler_max_input_samples: usize,
+}
+
+impl FixedParams {
+    /// convert the (validated) parameters to the given formats
+    pub fn new(params: ModelerParams, format: FixedFormat) -> Result<Self, String> {
+        let params = params.validate()?;
+        let format = format.validate()?;
+        Ok(Self {
+            format,
+            wobble_smoother_timeout: to_fixed(params.wobble_smoother_timeout, format.time_bits),
+            wobble_smoother_speed_floor: to_fixed(
+                params.wobble_smoother_speed_floor,
+                format.position_bits,
+            ),
+            wobble_smoother_speed_ceiling: to_fixed(
+                params.wobble_smoother_speed_ceiling,
+                format.position_bits,
+            ),
+            position_modeler_inverse_spring_mass_constant: to_fixed(
+                1.0 / params.position_modeler_spring_mass_constant,
+                format.unit_bits,
+            ),
+            position_modeler_drag_constant: to_fixed(
+                params.position_modeler_drag_constant,
+                format.unit_bits,
+            ),
+            sampling_min_output_rate: to_fixed(params.sampling_min_output_rate, format.unit_bits),
+            sampling_end_of_stroke_stopping_distance: to_fixed(
+                params.sampling_end_of_stroke_stopping_distance,
+                format.position_bits,
+            ),
+            sampling_end_of_stroke_max_iterations: params.sampling_end_of_stroke_max_iterations,
+            sampling_max_outputs_per_call: params.sampling_max_outputs_per_call,
+            stylus_state_modeler_max_input_samples: params.stylus_state_modeler_max_input_samples,
+        })
+    }
+
+    /// number of modeled positions between two inputs `delta_time` apart
+    fn resampling_steps(&self, delta_time: i64) -> i64 {
+        let bits = self.format.time_bits + self.format.unit_bits;
+        // ceil, the time delta is not bounded yet
+        ((delta_time as i128 * self.sampling_min_output_rate as i128 + (1 << bits) - 1) >> bits)
+            as i64
+    }
+
+    /// `1 / sampling_min_output_rate`, time format
+    fn sampling_period(&self) -> i64 {
+        div(
+            1 << self.format.time_bits,
+            self.sampling_min_output_rate,
+            self.format.unit_bits,
+        )
+    }
+}
+
+/// Fixed-point version of [StrokeModeler], see the [module documentation](self)
+pub struct FixedStrokeModeler {
+    params: FixedParams,
+    wobble: FixedWobbleSmoother,
+    position_modeler: Option<FixedPositionModeler>,
+    state_modeler: FixedStateModeler,
+    /// last event and corrected position, in the stroke-local frame
+    last_event: Option<FixedInput>,
+    last_corrected_event: Option<(i64, i64)>,
+    /// position and time of the `Down` event of the current (or last) stroke
+    origin: ((i64, i64), i64),
+    /// scratch buffer for the modeled positions
+    partial_buffer: Vec<FixedResult>,
+}
+
+impl FixedStrokeModeler {
+    pub fn new(params: FixedParams) -> Self {
+        Self {
+            wobble: FixedWobbleSmoother::new(params),
+            position_modeler: None,
+            state_modeler: FixedStateModeler::new(params.stylus_state_modeler_max_input_samples),
+            last_event: None,
+            last_corrected_event: None,
+            origin: ((0, 0), 0),
+            partial_buffer: Vec::with_capacity(
+                params.sampling_max_outputs_per_call + params.sampling_end_of_stroke_max_iterations,
+            ),
+            params,
+        }
+    }
+
+    /// Clears any in-progress stroke, keeping the parameters
+    pub fn reset(&mut self) {
+        self.wobble = FixedWobbleSmoother::new(self.params);
+        self.position_modeler = None;
+        self.state_modeler
+            .reset(self.params.stylus_state_modeler_max_input_samples);
+        self.last_event = None;
+        self.last_corrected_event = None;
+    }
+
+    /// Same as [StrokeModeler::update], in fixed point
+    pub fn update(&mut self, input: FixedInput) -> Result<Vec<FixedResult>, ModelerError> {
+        let mut results = Vec::new();
+        self.update_into(input, &mut results)?;
+        Ok(results)
+    }
+
+    /// Updates the model with a raw input and appends the newly generated results to `out`
+    pub fn update_into(
+        &mut self,
+        input: FixedInput,
+        out: &mut impl Extend<FixedResult>,
+    ) -> Result<(), ModelerError> {
+        if input.event_type == ModelerInputEventType::Down {
+            if self.last_event.is_some() {
+                return Err(ElementError::Order {
+                    src: ElementOrderError::UnexpectedDown,
+                }
+                .into());
+            }
+            // the durations between strokes can be arbitrarily long, the products of the
+            // wobble smoother only stay bounded within a stroke
+            self.wobble = FixedWobbleSmoother::new(self.params);
+            self.origin = (input.pos, input.time);
+        }
+        let ((origin_x, origin_y), origin_time) = self.origin;
+        let canvas = FixedInput {
+            pos: (input.pos.0 - origin_x, input.pos.1 - origin_y),
+            time: input.time - origin_time,
+            ..input
+        };
+        self.update_local(
+            canvas,
+            &mut MapResults {
+                out,
+                map: |result: FixedResult| FixedResult {
+                    pos: (result.pos.0 + origin_x, result.pos.1 + origin_y),
+                    time: result.time + origin_time,
+                    ..result
+                },
+            },
+        )
+    }
+
+    /// [FixedStrokeModeler::update_into] with the input and results in the stroke-local frame
+    fn update_local(
+        &mut self,
+        input: FixedInput,
+        out: &mut impl Extend<FixedResult>,
+    ) -> Result<(), ModelerError> {
+        if input.event_type == ModelerInputEventType::Down {
+            self.wobble.update(&self.params, input.pos, input.time);
+            self.position_modeler = Some(FixedPositionModeler::new(&input));
+            self.last_event = Some(input);
+            self.last_corrected_event = Some(input.pos);
+            self.state_modeler
+                .reset(self.params.stylus_state_modeler_max_input_samples);
+            self.state_modeler.update(&input);
+            out.extend(Some(FixedResult {
+                pos: input.pos,
+                time: input.time,
+                pressure: input.pressure,
+                ..FixedResult::default()
+            }));
+            return Ok(());
+        }
+
+        let last_event = match self.last_event {
+            Some(last_event) => last_event,
+            None => {
+                let src = match input.event_type {
+                    ModelerInputEventType::Move => ElementOrderError::UnexpectedMove,
+                    _ => ElementOrderError::UnexpectedUp,
+                };
+                return Err(ElementError::Order { src }.into());
+            }
+        };
+        let delta_time = input.time - last_event.time;
+        if delta_time < 0 {
+            return Err(ElementError::NegativeTimeDelta.into());
+        }
+        if input == last_event {
+            return Err(ElementError::Duplicate.into());
+        }
+        self.state_modeler.update(&input);
+        let n_steps = self.params.resampling_steps(delta_time);
+        if n_steps as usize > self.params.sampling_max_outputs_per_call {
+            return Err(ElementError::TooFarApart.into());
+        }
+
+        let p_start = self.last_corrected_event.unwrap();
+        let p_end = self.wobble.update(&self.params, input.pos, input.time);
+        let position_modeler = self.position_modeler.as_mut().unwrap();
+        position_modeler.update_along_linear_path(
+            &self.params,
+            (p_start, last_event.time),
+            (p_end, input.time),
+            n_steps,
+            &mut self.partial_buffer,
+        );
+
+        if input.event_type == ModelerInputEventType::Move {
+            self.last_event = Some(input);
+            self.last_corrected_event = Some(p_end);
+        } else {
+            let initial_len = self.partial_buffer.len();
+            position_modeler.model_end_of_stroke(&self.params, input.pos, &mut self.partial_buffer);
+            if self.partial_buffer.len() == initial_len {
+                // same as the float modeler, a last position later than the previous one
+                let state = position_modeler.state;
+                self.partial_buffer.push(FixedResult {
+                    time: state.time + self.params.sampling_period(),
+                    ..state
+                });
+            }
+            self.last_event = None;
+        }
+
+        let format = self.params.format;
+        let state_modeler = &self.state_modeler;
+        out.extend(self.partial_buffer.drain(..).map(|partial| FixedResult {
+            pressure: state_modeler.query(partial.pos, format),
+            ..partial
+        }));
+        Ok(())
+    }
+}
+
+/// Applies `map` to the results before appending them to `out`
+struct MapResults<'a, E, F> {
+    out: &'a mut E,
+    map: F,
+}
+
+impl<'a, E: Extend<FixedResult>, F: FnMut(FixedResult) -> FixedResult> Extend<FixedResult>
+    for MapResults<'a, E, F>
+{
+    fn extend<I: IntoIterator<Item = FixedResult>>(&mut self, iter: I) {
+        self.out.extend(iter.into_iter().map(&mut self.map));
+    }
+}
+
+struct FixedWobbleSample {
+    position: (i64, i64),
+    /// position weighted by the duration, position format
+    weighted_position: (i64, i64),
+    distance: i64,
+    duration: i64,
+    time: i64,
+}
+
+/// fixed-point version of the wobble smoother of [StrokeModeler]
+struct FixedWobbleSmoother {
+    samples: RingBuffer<FixedWobbleSample>,
+    weighted_pos_sum: (i64, i64),
+    distance_sum: i64,
+    duration_sum: i64,
+}
+
+impl FixedWobbleSmoother {
+    fn new(params: FixedParams) -> Self {
+        Self {
+            // same capacity as the float version
+            samples: RingBuffer::with_capacity(
+                (mul(
+                    2 * params.sampling_min_output_rate,
+                    params.wobble_smoother_timeout,
+                    params.format.time_bits,
+                ) >> params.format.unit_bits) as usize,
+            ),
+            weighted_pos_sum: (0, 0),
+            distance_sum: 0,
+            duration_sum: 0,
+        }
+    }
+
+    /// add the raw position and return the smoothed one
+    fn update(&mut self, params: &FixedParams, pos: (i64, i64), time: i64) -> (i64, i64) {
+        let format = params.format;
+        let last = match self.samples.back() {
+            None => {
+                self.samples.push_back(FixedWobbleSample {
+                    position: pos,
+                    weighted_position: (0, 0),
+                    distance: 0,
+                    duration: 0,
+                    time,
+                });
+                return pos;
+            }
+            Some(last) => last,
+        };
+        let duration = time - last.time;
+        let weighted_position = (
+            mul(pos.0, duration, format.time_bits),
+            mul(pos.1, duration, format.time_bits),
+        );
+        let distance = dist(last.position, pos);
+        self.samples.push_back(FixedWobbleSample {
+            position: pos,
+            weighted_position,
+            distance,
+            duration,
+            time,
+        });
+        self.weighted_pos_sum.0 += weighted_position.0;
+        self.weighted_pos_sum.1 += weighted_position.1;
+        self.distance_sum += distance;
+        self.duration_sum += duration;
+
+        while self.samples.front().unwrap().time < time - params.wobble_smoother_timeout {
+            let front = self.samples.pop_front().unwrap();
+            self.weighted_pos_sum.0 -= front.weighted_position.0;
+            self.weighted_pos_sum.1 -= front.weighted_position.1;
+            self.distance_sum -= front.distance;
+            self.duration_sum -= front.duration;
+        }
+
+        if self.duration_sum <= 0 {
+            return pos;
+        }
+        let avg_position = (
+            div(self.weighted_pos_sum.0, self.duration_sum, format.time_bits),
+            div(self.weighted_pos_sum.1, self.duration_sum, format.time_bits),
+        );
+        let avg_speed = div(self.distance_sum, self.duration_sum, format.time_bits);
+        let amount = normalize01(
+            params.wobble_smoother_speed_floor,
+            params.wobble_smoother_speed_ceiling,
+            avg_speed,
+            format.unit_bits,
+        );
+        (
+            interp(avg_position.0, pos.0, amount, format.unit_bits),
+            interp(avg_position.1, pos.1, amount, format.unit_bits),
+        )
+    }
+}
+
+/// fixed-point version of the spring-mass model of the pen tip
+struct FixedPositionModeler {
+    state: FixedResult,
+}
+
+impl FixedPositionModeler {
+    fn new(first_input: &FixedInput) -> Self {
+        Self {
+            state: FixedResult {
+                pos: first_input.pos,
+                time: first_input.time,
+                ..FixedResult::default()
+            },
+        }
+    }
+
+    fn update(&mut self, params: &FixedParams, anchor_pos: (i64, i64), time: i64) -> FixedResult {
+        let (time_bits, unit_bits) = (params.format.time_bits, params.format.unit_bits);
+        let delta_time = time - self.state.time;
+        let acceleration = |anchor: i64, pos: i64, velocity: i64| {
+            mul(
+                anchor - pos,
+                params.position_modeler_inverse_spring_mass_constant,
+                unit_bits,
+            ) - mul(params.position_modeler_drag_constant, velocity, unit_bits)
+        };
+        let state = &mut self.state;
+        state.acceleration = (
+            acceleration(anchor_pos.0, state.pos.0, state.velocity.0),
+            acceleration(anchor_pos.1, state.pos.1, state.velocity.1),
+        );
+        state.velocity.0 += mul(delta_time, state.acceleration.0, time_bits);
+        state.velocity.1 += mul(delta_time, state.acceleration.1, time_bits);
+        state.pos.0 += mul(delta_time, state.velocity.0, time_bits);
+        state.pos.1 += mul(delta_time, state.velocity.1, time_bits);
+        state.time = time;
+        *state
+    }
+
+    /// update the model `n_steps` times along the linear path from `start` to `end`
+    fn update_along_linear_path(
+        &mut self,
+        params: &FixedParams,
+        (start_pos, start_time): ((i64, i64), i64),
+        (end_pos, end_time): ((i64, i64), i64),
+        n_steps: i64,
+        out: &mut Vec<FixedResult>,
+    ) {
+        let step = |start: i64, end: i64, i: i64| start + (end - start) * i / n_steps;
+        out.extend((1..=n_steps).map(|i| {
+            let anchor_pos = (
+                step(start_pos.0, end_pos.0, i),
+                step(start_pos.1, end_pos.1, i),
+            );
+            self.update(params, anchor_pos, step(start_time, end_time, i))
+        }));
+    }
+
+    /// models the end of the stroke without modifying the state,
+    /// same as the float version
+    fn model_end_of_stroke(
+        &mut self,
+        params: &FixedParams,
+        anchor_pos: (i64, i64),
+        out: &mut Vec<FixedResult>,
+    ) {
+        let unit_bits = params.format.unit_bits;
+        let stop_distance = params.sampling_end_of_stroke_stopping_distance;
+        let initial_state = self.state;
+        let mut delta_time = params.sampling_period();
+
+        for _ in 0..params.sampling_end_of_stroke_max_iterations {
+            let previous_state = self.state;
+            let candidate = self.update(params, anchor_pos, previous_state.time + delta_time);
+
+            if dist(previous_state.pos, candidate.pos) < stop_distance {
+                break;
+            }
+            if nearest_point_on_segment(previous_state.pos, candidate.pos, anchor_pos, unit_bits)
+                < 1 << unit_bits
+            {
+                // overshoot, try with a smaller delta t
+                delta_time /= 2;
+                self.state = previous_state;
+                continue;
+            }
+            out.push(candidate);
+
+            if dist(candidate.pos, anchor_pos) < stop_distance {
+                break;
+            }
+        }
+        self.state = initial_state;
+    }
+}
+
+/// fixed-point version of the pressure interpolation from the raw inputs
+struct FixedStateModeler {
+    max_input_samples: usize,
+    /// position and pressure of the last raw inputs
+    samples: RingBuffer<((i64, i64), i64)>,
+}
+
+impl FixedStateModeler {
+    fn new(max_input_samples: usize) -> Self {
+        let max_input_samples = max_input_samples.max(1);
+        Self {
+            max_input_samples,
+            samples: RingBuffer::with_capacity(max_input_samples + 1),
+        }
+    }
+
+    fn reset(&mut self, max_input_samples: usize) {
+        self.samples.clear();
+        self.max_input_samples = max_input_samples.max(1);
+    }
+
+    fn update(&mut self, input: &FixedInput) {
+        self.samples.push_back((input.pos, input.pressure));
+        if self.samples.len() > self.max_input_samples {
+            self.samples.pop_front();
+        }
+    }
+
+    /// pressure interpolated from the raw input segment closest to `pos`, unit format
+    fn query(&self, pos: (i64, i64), format: FixedFormat) -> i64 {
+        let unit_bits = format.unit_bits;
+        match self.samples.len() {
+            0 => 1 << unit_bits,
+            1 => self.samples.front().unwrap().1,
+            len => {
+                let mut best: Option<(u128, i64)> = None;
+                let mut pressure = 1 << unit_bits;
+                for index in 0..len - 1 {
+                    let (start_pos, start_pressure) = *self.samples.get(index).unwrap();
+                    let (end_pos, end_pressure) = *self.samples.get(index + 1).unwrap();
+                    let ratio = nearest_point_on_segment(start_pos, end_pos, pos, unit_bits);
+                    let point = (
+                        interp(start_pos.0, end_pos.0, ratio, unit_bits),
+                        interp(start_pos.1, end_pos.1, ratio, unit_bits),
+                    );
+                    // squared distances compare the same as the distances
+                    let distance = squared_dist(pos, point);
+                    if best.map_or(true, |(best, _)| distance < best) {
+                        best = Some((distance, ratio));
+                        pressure = interp(start_pressure, end_pressure, ratio, unit_bits);
+                    }
+                }
+                pressure
+            }
+        }
+    }
+}
+
+fn to_fixed(value: f64, bits: u32) -> i64 {
+    (value * (1u64 << bits) as f64).round() as i64
+}
+
+fn from_fixed(value: i64, bits: u32) -> f64 {
+    value as f64 / (1u64 << bits) as f64
+}
+
+/// product of `a` and `b`, with `b` having `bits` fractional bits, rounded to nearest
+fn mul(a: i64, b: i64, bits: u32) -> i64 {
+    ((a as i128 * b as i128 + (1 << (bits - 1))) >> bits) as i64
+}
+
+/// quotient of `a` by `b`, with the result having `bits` more fractional bits than `a / b`
+fn div(a: i64, b: i64, bits: u32) -> i64 {
+    (((a as i128) << bits) / b as i128) as i64
+}
+
+/// interpolation from `start` to `end`, with `amount` clamped between 0 and 1
+fn interp(start: i64, end: i64, amount: i64, unit_bits: u32) -> i64 {
+    start + mul(end - start, amount.clamp(0, 1 << unit_bits), unit_bits)
+}
+
+/// `(value - start) / (end - start)` clamped between 0 and 1, unit format
+fn normalize01(start: i64, end: i64, value: i64, unit_bits: u32) -> i64 {
+    if start == end {
+        if value > start {
+            1 << unit_bits
+        } else {
+            0
+        }
+    } else {
+        div(value - start, end - start, unit_bits).clamp(0, 1 << unit_bits)
+    }
+}
+
+fn squared_dist(start: (i64, i64), end: (i64, i64)) -> u128 {
+    let delta = (
+        (end.0 - start.0).unsigned_abs() as u128,
+        (end.1 - start.1).unsigned_abs() as u128,
+    );
+    delta.0 * delta.0 + delta.1 * delta.1
+}
+
+/// distance with the format of the positions
+fn dist(start: (i64, i64), end: (i64, i64)) -> i64 {
+    isqrt(squared_dist(start, end)) as i64
+}
+
+/// ratio along the segment from `start` to `end` of the point closest to `point`,
+/// clamped between 0 and 1, unit format
+fn nearest_point_on_segment(
+    start: (i64, i64),
+    end: (i64, i64),
+    point: (i64, i64),
+    unit_bits: u32,
+) -> i64 {
+    if start == end {
+        return 0;
+    }
+    let segment = ((end.0 - start.0) as i128, (end.1 - start.1) as i128);
+    let projected = ((point.0 - start.0) as i128, (point.1 - start.1) as i128);
+    let length = segment.0 * segment.0 + segment.1 * segment.1;
+    // clamped first so that the ratio is at most 1
+    let projected = (projected.0 * segment.0 + projected.1 * segment.1).clamp(0, length);
+    if length < 1 << (126 - unit_bits) {
+        ((projected << unit_bits) / length) as i64
+    } else {
+        // no room to shift the dividend, the precision is lost on the divisor instead
+        (projected / (length >> unit_bits)) as i64
+    }
+}
+
+/// integer square root, rounded down
+fn isqrt(value: u128) -> u128 {
+    if value < 2 {
+        return value;
+    }
+    // Newton iterations from a power of two above the root
+    let mut root = 1u128 << ((128 - value.leading_zeros() + 1) / 2);
+    loop {
+        let next = (root + value / root) / 2;
+        if next >= root {
+            return root;
+        }
+        root = next;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// stroke of the `stroke` example
+    fn example_stroke() -> Vec<ModelerInput> {
+        [
+            (90.0, 30.0, 0.0, 0.25),
+            (30.0, 45.0, 0.02, 0.3),
+            (60.0, 240.0, 0.04, 0.7),
+            (105.0, 270.0, 0.06, 1.0),
+            (120.0, 150.0, 0.10, 0.6),
+            (180.0, 30.0, 0.12, 0.3),
+            (240.0, 120.0, 0.16, 0.3),
+            (210.0, 150.0, 0.18, 0.9),
+            (150.0, 210.0, 0.20, 0.8),
+            (210.0, 240.0, 0.22, 0.8),
+            (255.0, 240.0, 0.24, 0.7),
+            (270.0, 270.0, 0.26, 0.5),
+        ]
+        .iter()
+        .enumerate()
+        .map(|(i, &(x, y, time, pressure))| ModelerInput {
+            event_type: match i {
+                0 => ModelerInputEventType::Down,
+                11 => ModelerInputEventType::Up,
+                _ => ModelerInputEventType::Move,
+            },
+            pos: (x, y),
+            time,
+            pressure,
+        })
+        .collect()
+    }
+
+    /// slow and shaky stroke, smoothed by the wobble smoother
+    fn slow_stroke() -> Vec<ModelerInput> {
+        (0..60)
+            .map(|i| ModelerInput {
+                event_type: match i {
+                    0 => ModelerInputEventType::Down,
+                    59 => ModelerInputEventType::Up,
+                    _ => ModelerInputEventType::Move,
+                },
+                pos: (
+                    0.01 * i as f64 + if i % 2 == 0 { 0.02 } else { -0.02 },
+                    0.5 * (0.1 * i as f64).sin(),
+                ),
+                time: 0.0043 * i as f64,
+                pressure: 0.5 + 0.4 * (0.2 * i as f64).cos(),
+            })
+            .collect()
+    }
+
+    #[test]
+    fn cross_check() {
+        let params = ModelerParams::suggested();
+        let format = FixedFormat::suggested();
+        let mut fixed = FixedStrokeModeler::new(FixedParams::new(params, format).unwrap());
+        let mut float = StrokeModeler::new(params).unwrap();
+
+        // the modelers are reused across strokes
+        for stroke in [example_stroke(), slow_stroke(), example_stroke()] {
+            for input in stroke {
+                let expected = float.update(input.clone()).unwrap();
+                let results = fixed.update(format.input(&input)).unwrap();
+                assert_eq!(results.len(), expected.len());
+                for (result, expected) in results.iter().zip(expected.iter()) {
+                    let result = format.result(result);
+                    approx::assert_abs_diff_eq!(result.pos.0, expected.pos.0, epsilon = 1e-3);
+                    approx::assert_abs_diff_eq!(result.pos.1, expected.pos.1, epsilon = 1e-3);
+                    approx::assert_abs_diff_eq!(result.pressure, expected.pressure, epsilon = 1e-3);
+                    approx::assert_abs_diff_eq!(result.time, expected.time, epsilon = 1e-6);
+                    // speeds are up to a few thousands
+                    approx::assert_abs_diff_eq!(
+                        result.velocity.0,
+                        expected.velocity.0,
+                        epsilon = 0.05
+                    );
+                    approx::assert_abs_diff_eq!(
+                        result.velocity.1,
+                        expected.velocity.1,
+                        epsilon = 0.05
+                    );
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn far_apart_strokes() {
+        let params = ModelerParams::suggested();
+        let format = FixedFormat::suggested();
+        let mut fixed = FixedStrokeModeler::new(FixedParams::new(params, format).unwrap());
+        let mut float = StrokeModeler::new(params).unwrap();
+
+        // near the documented bounds : 600 s between the strokes, positions 16000 away
+        // from the origin, then a stroke at large absolute coordinates and time
+        let strokes = [(16000.0, 0.0), (16000.0, 600.0), (1e9, 1e9)];
+        for (offset, start) in strokes {
+            // unlike the fixed-point one, the float wobble smoother keeps its samples
+            // across strokes
+            float.reset();
+            for input in example_stroke() {
+                let input = ModelerInput {
+                    pos: (input.pos.0 + offset, input.pos.1 + offset),
+                    time: input.time + start,
+                    ..input
+                };
+                let expected = float.update(input.clone()).unwrap();
+                let results = fixed.update(format.input(&input)).unwrap();
+                assert_eq!(results.len(), expected.len());
+                for (result, expected) in results.iter().zip(expected.iter()) {
+                    let result = format.result(result);
+                    approx::assert_abs_diff_eq!(result.pos.0, expected.pos.0, epsilon = 1e-3);
+                    approx::assert_abs_diff_eq!(result.pos.1, expected.pos.1, epsilon = 1e-3);
+                    approx::assert_abs_diff_eq!(result.time, expected.time, epsilon = 1e-6);
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn wide_formats() {
+        let params = ModelerParams::suggested();
+        // all the bits, positions up to 2^18 from the `Down` position
+        let format = FixedFormat {
+            position_bits: 30,
+            time_bits: 30,
+            unit_bits: 30,
+        };
+        let mut fixed = FixedStrokeModeler::new(FixedParams::new(params, format).unwrap());
+        let mut float = StrokeModeler::new(params).unwrap();
+        for input in example_stroke() {
+            let input = ModelerInput {
+                pos: (4.0 * input.pos.0, 4.0 * input.pos.1),
+                ..input
+            };
+            let expected = float.update(input.clone()).unwrap();
+            let results = fixed.update(format.input(&input)).unwrap();
+            assert_eq!(results.len(), expected.len());
+            for (result, expected) in results.iter().zip(expected.iter()) {
+                let result = format.result(result);
+                approx::assert_abs_diff_eq!(result.pos.0, expected.pos.0, epsilon = 1e-3);
+                approx::assert_abs_diff_eq!(result.pos.1, expected.pos.1, epsilon = 1e-3);
+                approx::assert_abs_diff_eq!(result.pressure, expected.pressure, epsilon = 1e-3);
+            }
+        }
+
+        // a time gap far above the resampling limit is rejected, not overflowed
+        let format = FixedFormat::suggested();
+        let mut fixed = FixedStrokeModeler::new(FixedParams::new(params, format).unwrap());
+        let stroke = example_stroke();
+        fixed.update(format.input(&stroke[0])).unwrap();
+        let late = ModelerInput {
+            time: 1e6,
+            ..stroke[1].clone()
+        };
+        assert!(matches!(
+            fixed.update(format.input(&late)),
+            Err(ModelerError::Element {
+                src: ElementError::TooFarApart
+            })
+        ));
+    }
+
+    #[test]
+    fn input_order_errors() {
+        let format = FixedFormat::suggested();
+        let mut fixed =
+            FixedStrokeModeler::new(FixedParams::new(ModelerParams::suggested(), format).unwrap());
+        let stroke = example_stroke();
+        assert!(fixed.update(format.input(&stroke[1])).is_err());
+        fixed.update(format.input(&stroke[0])).unwrap();
+        assert!(fixed.update(format.input(&stroke[0])).is_err());
+        fixed.update(format.input(&stroke[2])).unwrap();
+        // duplicate and negative time delta
+        assert!(fixed.update(format.input(&stroke[2])).is_err());
+        assert!(fixed.update(format.input(&stroke[1])).is_err());
+
+        fixed.reset();
+        assert!(fixed.update(format.input(&stroke[11])).is_err());
+    }
+
+    #[test]
+    fn invalid_format() {
+        let format = FixedFormat {
+            time_bits: 40,
+            ..FixedFormat::suggested()
+        };
+        assert!(FixedParams::new(ModelerParams::suggested(), format).is_err());
+    }
+
+    #[test]
+    fn integer_helpers() {
+        assert_eq!(isqrt(0), 0);
+        assert_eq!(isqrt(15), 3);
+        assert_eq!(isqrt(16), 4);
+        assert_eq!(isqrt(u64::MAX as u128), u32::MAX as u128);
+        assert_eq!(isqrt(u128::MAX), u64::MAX as u128);
+        // 0.25 * 0.5 in Q8
+        assert_eq!(mul(64, 128, 8), 32);
+        assert_eq!(div(64, 128, 8), 128);
+        assert_eq!(normalize01(0, 256, 512, 8), 256);
+        assert_eq!(nearest_point_on_segment((0, 0), (4, 0), (1, 5), 8), 64);
+    }
+}
@@ -0,0 +1,179 @@
+//! Kernels whose implementation is selected at runtime from the CPU features
+//!
+//! A single binary runs on machines with different instruction sets : the hot loops
+//! are compiled once per [KernelLevel] and the best level supported by the CPU is
+//! selected once, when the modeler is constructed. All levels give bit-identical results
+use crate::utils::{dist, interp2, nearest_point_on_segment};
+
+/// Instruction set used by the kernels
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum KernelLevel {
+    /// portable code, using the instruction set the crate is compiled for
+    Scalar,
+    /// AVX2 code, x86 and x86_64 only
+    Avx2,
+}
+
+impl KernelLevel {
+    /// all the levels, supported or not
+    pub const ALL: [KernelLevel; 2] = [KernelLevel::Scalar, KernelLevel::Avx2];
+
+    /// The best level supported by the CPU
+    ///
+    /// Setting the `INK_STROKE_MODELER_KERNELS` environment variable to `scalar`
+    /// forces [KernelLevel::Scalar]
+    pub fn detect() -> Self {
+        if std::env::var_os("INK_STROKE_MODELER_KERNELS").map_or(false, |var| var == "scalar") {
+            return KernelLevel::Scalar;
+        }
+        Self::ALL
+            .iter()
+            .rev()
+            .copied()
+            .find(|level| level.is_supported())
+            .unwrap_or(KernelLevel::Scalar)
+    }
+
+    /// whether the CPU supports this level
+    pub fn is_supported(self) -> bool {
+        match self {
+            KernelLevel::Scalar => true,
+            #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+            KernelLevel::Avx2 => std::is_x86_feature_detected!("avx2"),
+            #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
+            KernelLevel::Avx2 => false,
+        }
+    }
+}
+
+/// signature of [segment_distances]
+type SegmentDistances = fn(&[f64], &[f64], (f64, f64), &mut [f64], &mut [f64]);
+
+/// The kernel implementations for a [KernelLevel]
+#[derive(Clone, Copy)]
+pub(crate) struct Kernels {
+    level: KernelLevel,
+    segment_distances: SegmentDistances,
+}
+
+impl Kernels {
+    /// kernels of the best level supported by the CPU
+    pub(crate) fn detect() -> Self {
+        Self::new(KernelLevel::detect()).unwrap()
+    }
+
+    /// `None` if the level is not supported by the CPU
+    pub(crate) fn new(level: KernelLevel) -> Option<Self> {
+        if !level.is_supported() {
+            return None;
+        }
+        let segment_distances: SegmentDistances = match level {
+            KernelLevel::Scalar => segment_distances,
+            #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+            KernelLevel::Avx2 => x86::segment_distances_avx2,
+            #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
+            KernelLevel::Avx2 => return None,
+        };
+        Some(Self {
+            level,
+            segment_distances,
+        })
+    }
+
+    pub(crate) fn level(&self) -> KernelLevel {
+        self.level
+    }
+
+    /// Index of the segment of the polyline `(xs, ys)` closest to `pos`, and the ratio along
+    /// this segment of the closest point. The first closest segment is returned on ties
+    ///
+    /// `ratios` and `distances` are scratch buffers with one element per segment
+    pub(crate) fn nearest_segment(
+        &self,
+        (xs, ys): (&[f64], &[f64]),
+        pos: (f64, f64),
+        ratios: &mut [f64],
+        distances: &mut [f64],
+    ) -> (usize, f64) {
+        (self.segment_distances)(xs, ys, pos, ratios, distances);
+        let mut nearest = (0, f64::INFINITY);
+        for (index, &distance) in distances.iter().enumerate() {
+            if distance < nearest.1 {
+                nearest = (index, distance);
+            }
+        }
+        (nearest.0, ratios[nearest.0])
+    }
+}
+
+/// For each segment of the polyline `(xs, ys)`, the ratio along the segment of the point
+/// closest to `pos` and the distance to this point
+///
+/// Straight-line code over arrays, so that the compiler vectorizes it for each level
+#[inline(always)]
+fn segment_distances(
+    xs: &[f64],
+    ys: &[f64],
+    pos: (f64, f64),
+    ratios: &mut [f64],
+    distances: &mut [f64],
+) {
+    let n_segments = ratios.len().min(distances.len());
+    let (xs, ys) = (&xs[..n_segments + 1], &ys[..n_segments + 1]);
+    for index in 0..n_segments {
+        let start = (xs[index], ys[index]);
+        let end = (xs[index + 1], ys[index + 1]);
+        let ratio = nearest_point_on_segment(start, end, pos);
+        ratios[index] = ratio;
+        distances[index] = dist(pos, interp2(start, end, ratio));
+    }
+}
+
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+mod x86 {
+    pub(super) fn segment_distances_avx2(
+        xs: &[f64],
+        ys: &[f64],
+        pos: (f64, f64),
+        ratios: &mut [f64],
+        distances: &mut [f64],
+    ) {
+        #[target_feature(enable = "avx2")]
+        unsafe fn avx2(
+            xs: &[f64],
+            ys: &[f64],
+            pos: (f64, f64),
+            ratios: &mut [f64],
+            distances: &mut [f64],
+        ) {
+            super::segment_distances(xs, ys, pos, ratios, distances)
+        }
+        // SAFETY: only selected by `Kernels::new` when AVX2 is detected
+        unsafe { avx2(xs, ys, pos, ratios, distances) }
+    }
+}
+
+#[test]
+fn kernel_levels_agree() {
+    let xs: Vec<f64> = (0..16).map(|i| (0.7 * i as f64).cos() * i as f64).collect();
+    let ys: Vec<f64> = (0..16).map(|i| (0.7 * i as f64).sin() * i as f64).collect();
+    let mut expected = None;
+    for kernels in KernelLevel::ALL
+        .iter()
+        .filter_map(|&level| Kernels::new(level))
+    {
+        let mut ratios = vec![0.0; 15];
+        let mut distances = vec![0.0; 15];
+        let results: Vec<(usize, f64)> = (0..50)
+            .map(|i| {
+                let pos = (0.37 * i as f64 - 9.0, 0.21 * i as f64 - 5.0);
+                kernels.nearest_segment((&xs, &ys), pos, &mut ratios, &mut distances)
+            })
+            .collect();
+        match &expected {
+            None => expected = Some(results),
+            Some(expected) => assert_eq!(&results, expected),
+        }
+    }
+    assert!(Kernels::new(KernelLevel::Scalar).is_some());
+}
@@ -0,0 +1,334 @@
+//! End-to-end ink latency simulation
+//!
+//! Replays a pen trace on a virtual clock to measure how far the displayed ink
+//! (results committed by [StrokeModeler::update], plus the output of [StrokeModeler::predict]
+//! if enabled) trails the true pen position at each displayed frame.
+//!
+//! The simulated pipeline is the following :
+//! - the pen is sampled at [SimulationConfig::input_rate] along the trace
+//! - each sample is delivered to the modeler [SimulationConfig::input_delay] later
+//! - each [StrokeModeler::update] call takes [SimulationConfig::modeling_cost], calls are
+//!   serialized so that inputs queue up if the modeler is slower than the input rate
+//! - a frame is displayed every `1 / frame_rate`, with all the results available at that time.
+//!   The prediction is computed as part of the frame, from the state available at that time
+use crate::utils::{dist, interp, interp2, normalize01_64};
+use crate::{ModelerInput, ModelerInputEventType, ModelerParams, StrokeModeler};
+
+/// What is displayed after the committed results
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PredictionMode {
+    /// only the committed results are displayed
+    Disabled,
+    /// the output of [StrokeModeler::predict] is displayed after the committed results
+    Predict,
+}
+
+/// Configuration of the simulated input and display pipeline
+///
+/// All durations are in the time unit of the trace and rates are per unit of time
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SimulationConfig {
+    /// rate at which the pen position is sampled
+    pub input_rate: f64,
+    /// delay between the sampling of the pen position and its delivery to the modeler
+    pub input_delay: f64,
+    /// rate at which frames are displayed
+    pub frame_rate: f64,
+    /// duration of a call to [StrokeModeler::update]
+    pub modeling_cost: f64,
+    pub prediction: PredictionMode,
+}
+
+impl SimulationConfig {
+    /// [SimulationConfig::input_rate] : 240.0,\
+    /// [SimulationConfig::input_delay] : 0.008,\
+    /// [SimulationConfig::frame_rate] : 60.0,\
+    /// [SimulationConfig::modeling_cost] : 0.0002,\
+    /// [SimulationConfig::prediction] : [PredictionMode::Predict],
+    pub fn suggested() -> Self {
+        Self {
+            input_rate: 240.0,
+            input_delay: 0.008,
+            frame_rate: 60.0,
+            modeling_cost: 0.0002,
+            prediction: PredictionMode::Predict,
+        }
+    }
+}
+
+/// Distribution of the distances between the tip of the displayed ink and the true pen
+/// position, one per displayed frame
+#[derive(Debug, Clone, PartialEq)]
+pub struct LatencyReport {
+    /// lags sorted in increasing order
+    lags: Vec<f64>,
+}
+
+impl LatencyReport {
+    /// number of frames measured
+    pub fn len(&self) -> usize {
+        self.lags.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.lags.is_empty()
+    }
+
+    /// the lags, sorted in increasing order
+    pub fn lags(&self) -> &[f64] {
+        &self.lags
+    }
+
+    pub fn mean(&self) -> f64 {
+        if self.lags.is_empty() {
+            return 0.0;
+        }
+        self.lags.iter().sum::<f64>() / self.lags.len() as f64
+    }
+
+    pub fn max(&self) -> f64 {
+        self.lags.last().copied().unwrap_or(0.0)
+    }
+
+    /// nearest-rank percentile, with `percentile` between 0 and 100
+    pub fn percentile(&self, percentile: f64) -> f64 {
+        if self.lags.is_empty() {
+            return 0.0;
+        }
+        let rank = (percentile.clamp(0.0, 100.0) / 100.0 * self.lags.len() as f64).ceil() as usize;
+        self.lags[rank.max(1) - 1]
+    }
+}
+
+/// Replays the pen `trace` through a [StrokeModeler] with the given parameters and
+/// returns the lag of the displayed ink at each frame while the pen is moving
+///
+/// The trace gives the true pen position (and pressure) over time, linearly interpolated
+/// between its elements. Its event types are ignored. Returns an error if the trace has
+/// less than two elements or decreasing times, if the parameters or the configuration are
+/// invalid or if the modeler rejects an input
+pub fn simulate(
+    trace: &[ModelerInput],
+    params: ModelerParams,
+    config: SimulationConfig,
+) -> Result<LatencyReport, String> {
+    if trace.len() < 2 {
+        return Err(String::from("the trace needs at least two elements"));
+    }
+    if trace.windows(2).any(|w| w[1].time < w[0].time) {
+        return Err(String::from("the trace times are decreasing"));
+    }
+    if !(config.input_rate > 0.0 && config.frame_rate > 0.0) {
+        return Err(String::from("the input and frame rates should be positive"));
+    }
+    let valid_duration = |duration: f64| duration >= 0.0 && duration.is_finite();
+    if !(valid_duration(config.input_delay) && valid_duration(config.modeling_cost)) {
+        return Err(String::from(
+            "the input delay and modeling cost should be finite and non negative",
+        ));
+    }
+
+    let mut modeler = StrokeModeler::new(params)?;
+    let start_time = trace.first().unwrap().time;
+    let end_time = trace.last().unwrap().time;
+
+    // pen samples
+    let n_inputs = ((end_time - start_time) * config.input_rate).floor() as usize + 1;
+    let inputs: Vec<ModelerInput> = (0..=n_inputs)
+        .map(|i| {
+            let time = if i == n_inputs {
+                end_time
+            } else {
+                start_time + i as f64 / config.input_rate
+            };
+            let (pos, pressure) = pen_state(trace, time);
+            ModelerInput {
+                event_type: match i {
+                    0 => ModelerInputEventType::Down,
+                    _ if i == n_inputs => ModelerInputEventType::Up,
+                    _ => ModelerInputEventType::Move,
+                },
+                pos,
+                time,
+                pressure,
+            }
+        })
+        // the last regular sample may coincide with the end of the trace
+        .filter(|input| input.event_type == ModelerInputEventType::Up || input.time < end_time)
+        .collect();
+
+    let mut lags = Vec::new();
+    let mut next_input = 0;
+    let mut busy_until = start_time;
+    let mut displayed_tip: Option<(f64, f64)> = None;
+    let mut frame = 1;
+    loop {
+        let frame_time = start_time + frame as f64 / config.frame_rate;
+        if frame_time > end_time {
+            break;
+        }
+
+        // inputs whose modeling is done by the time the frame is displayed
+        while let Some(input) = inputs.get(next_input) {
+            let modeling_start = (input.time + config.input_delay).max(busy_until);
+            if modeling_start + config.modeling_cost > frame_time {
+                break;
+            }
+            busy_until = modeling_start + config.modeling_cost;
+            let results = modeler
+                .update(input.clone())
+                .map_err(|e| format!("{e} at time {}", input.time))?;
+            if let Some(last) = results.last() {
+                displayed_tip = Some(last.pos);
+            }
+            next_input += 1;
+        }
+
+        let mut tip = displayed_tip;
+        if config.prediction == PredictionMode::Predict {
+            // fails when no stroke is in progress, the committed results are displayed then
+            if let Some(last) = modeler.predict().ok().and_then(|p| p.last().map(|r| r.pos)) {
+                tip = Some(last);
+            }
+        }
+        if let Some(tip) = tip {
+            lags.push(dist(tip, pen_state(trace, frame_time).0));
+        }
+        frame += 1;
+    }
+
+    lags.sort_by(f64::total_cmp);
+    Ok(LatencyReport { lags })
+}
+
+/// position and pressure of the pen at `time`, interpolated from the trace
+fn pen_state(trace: &[ModelerInput], time: f64) -> ((f64, f64), f64) {
+    let index = trace
+        .partition_point(|el| el.time <= time)
+        .clamp(1, trace.len() - 1);
+    let (start, end) = (&trace[index - 1], &trace[index]);
+    let amount = normalize01_64(start.time, end.time, time);
+    (
+        interp2(start.pos, end.pos, amount),
+        interp(start.pressure, end.pressure, amount),
+    )
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// straight line at constant speed
+    fn line_trace() -> Vec<ModelerInput> {
+        vec![
+            ModelerInput {
+                pos: (0.0, 0.0),
+                time: 0.0,
+                ..ModelerInput::default()
+            },
+            ModelerInput {
+                pos: (5.0, 0.0),
+                time: 0.5,
+                ..ModelerInput::default()
+            },
+        ]
+    }
+
+    #[test]
+    fn pen_state_interpolation() {
+        let trace = line_trace();
+        assert_eq!(pen_state(&trace, 0.25).0, (2.5, 0.0));
+        assert_eq!(pen_state(&trace, -1.0).0, (0.0, 0.0));
+        assert_eq!(pen_state(&trace, 1.0).0, (5.0, 0.0));
+    }
+
+    #[test]
+    fn report_statistics() {
+        let report = LatencyReport {
+            lags: vec![1.0, 2.0, 3.0, 4.0],
+        };
+        approx::assert_relative_eq!(report.mean(), 2.5);
+        approx::assert_relative_eq!(report.max(), 4.0);
+        approx::assert_relative_eq!(report.percentile(50.0), 2.0);
+        approx::assert_relative_eq!(report.percentile(100.0), 4.0);
+        approx::assert_relative_eq!(report.percentile(0.0), 1.0);
+    }
+
+    #[test]
+    fn prediction_and_delay() {
+        let params = ModelerParams::suggested();
+        let predicted = simulate(&line_trace(), params, SimulationConfig::suggested()).unwrap();
+        let not_predicted = simulate(
+            &line_trace(),
+            params,
+            SimulationConfig {
+                prediction: PredictionMode::Disabled,
+                ..SimulationConfig::suggested()
+            },
+        )
+        .unwrap();
+        let delayed = simulate(
+            &line_trace(),
+            params,
+            SimulationConfig {
+                input_delay: 0.05,
+                ..SimulationConfig::suggested()
+            },
+        )
+        .unwrap();
+
+        // one frame per 1/60 s during 0.5 s
+        assert_eq!(predicted.len(), 30);
+        assert!(predicted.mean() < not_predicted.mean());
+        assert!(predicted.mean() < delayed.mean());
+        // 10 units per unit of time, delayed by at least 0.05
+        assert!(delayed.percentile(50.0) > 0.5);
+    }
+
+    #[test]
+    fn invalid_trace() {
+        let params = ModelerParams::suggested();
+        let config = SimulationConfig::suggested();
+        assert!(simulate(&line_trace()[..1], params, config).is_err());
+        let mut reversed = line_trace();
+        reversed.reverse();
+        assert!(simulate(&reversed, params, config).is_err());
+    }
+
+    #[test]
+    fn invalid_config() {
+        let params = ModelerParams::suggested();
+        let invalid = [
+            SimulationConfig {
+                frame_rate: 0.0,
+                ..SimulationConfig::suggested()
+            },
+            SimulationConfig {
+                input_delay: -0.01,
+                ..SimulationConfig::suggested()
+            },
+            SimulationConfig {
+                input_delay: f64::NAN,
+                ..SimulationConfig::suggested()
+            },
+            SimulationConfig {
+                modeling_cost: -0.001,
+                ..SimulationConfig::suggested()
+            },
+            SimulationConfig {
+                modeling_cost: f64::NAN,
+                ..SimulationConfig::suggested()
+            },
+        ];
+        for config in invalid {
+            assert!(simulate(&line_trace(), params, config).is_err());
+        }
+        // no delay nor cost is valid
+        let instant = SimulationConfig {
+            input_delay: 0.0,
+            modeling_cost: 0.0,
+            ..SimulationConfig::suggested()
+        };
+        assert!(simulate(&line_trace(), params, instant).is_ok());
+    }
+}
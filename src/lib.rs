@@ -1,10 +1,22 @@
 // Modules
+pub mod batch;
+pub mod corners;
+pub mod decimation;
 mod engine;
 pub mod error;
+pub mod fixed;
 mod input;
+mod kernels;
+pub mod latency;
 mod params;
 mod position_modeler;
+pub mod remote;
 mod results;
+mod ring_buffer;
+pub mod scheduler;
+#[cfg(all(feature = "shm", target_os = "linux"))]
+pub mod shm;
+mod spike_filter;
 mod state_modeler;
 mod utils;
 
@@ -12,9 +24,13 @@ mod utils;
 extern crate approx;
 
 // Re-Exports
+pub use allocator_api2;
 pub use engine::StrokeModeler;
 pub use error::ModelerError;
 pub use input::ModelerInput;
 pub use input::ModelerInputEventType;
+pub use kernels::KernelLevel;
 pub use params::ModelerParams;
+pub use results::LocalModelerResult;
 pub use results::ModelerResult;
+pub use results::StrokeOrigin;
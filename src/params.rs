@@ -72,6 +72,34 @@ pub struct ModelerParams {
     ///
     /// Should be strictly positive
     pub stylus_state_modeler_max_input_samples: usize,
+    /// Maximum plausible acceleration of the raw inputs (increase in speed per unit time).
+    /// When set, a raw input implying a larger acceleration is held back for one sample and
+    /// dropped if the next input shows it was an isolated position spike.
+    ///
+    /// A good starting point is an order of magnitude above the accelerations of
+    /// genuine fast strokes. `None` disables the filter
+    ///
+    /// Should be positive
+    pub spike_filter_max_acceleration: Option<f64>,
+    /// Time horizon of the raw inputs kept for the pressure lookups, in addition to
+    /// [ModelerParams::stylus_state_modeler_max_input_samples] : the oldest input is dropped
+    /// once the next one is older than this duration before the raw input nearest to the
+    /// modeled position. `None` only limits the number of inputs
+    ///
+    /// As the horizon is counted from the modeled position, it is a margin on top of the
+    /// lag of the model (a few hundredths of a time unit with the suggested parameters) and
+    /// the pressures do not depend on it as long as it covers the turns of the stroke
+    /// around the modeled position (0.1 is a good starting point). The count limit then
+    /// only acts as a cap, whatever the input rate
+    ///
+    /// Should be positive
+    pub stylus_state_modeler_max_input_duration: Option<f64>,
+    /// Same as [ModelerParams::stylus_state_modeler_max_input_duration] with the arc
+    /// length of the raw inputs between the oldest one and the point nearest to the
+    /// modeled position
+    ///
+    /// Should be positive
+    pub stylus_state_modeler_max_input_distance: Option<f64>,
 }
 
 impl ModelerParams {
@@ -84,7 +112,10 @@ impl ModelerParams {
     /// [ModelerParams::sampling_end_of_stroke_stopping_distance] : 0.001,\
     /// [ModelerParams::sampling_end_of_stroke_max_iterations] : 20,\
     /// [ModelerParams::sampling_max_outputs_per_call] : 20,\
-    /// [ModelerParams::stylus_state_modeler_max_input_samples] : 10,
+    /// [ModelerParams::stylus_state_modeler_max_input_samples] : 10,\
+    /// [ModelerParams::spike_filter_max_acceleration] : None,\
+    /// [ModelerParams::stylus_state_modeler_max_input_duration] : None,\
+    /// [ModelerParams::stylus_state_modeler_max_input_distance] : None,
     pub fn suggested() -> Self {
         Self {
             wobble_smoother_timeout: 0.04,
@@ -97,6 +128,9 @@ impl ModelerParams {
             sampling_end_of_stroke_max_iterations: 20,
             sampling_max_outputs_per_call: 20,
             stylus_state_modeler_max_input_samples: 10,
+            spike_filter_max_acceleration: None,
+            stylus_state_modeler_max_input_duration: None,
+            stylus_state_modeler_max_input_distance: None,
         }
     }
 
@@ -115,6 +149,12 @@ impl ModelerParams {
             self.wobble_smoother_speed_floor > 0.0,
             self.wobble_smoother_speed_ceiling > 0.0,
             self.wobble_smoother_speed_floor < self.wobble_smoother_speed_ceiling,
+            self.spike_filter_max_acceleration
+                .map_or(true, |max_acceleration| max_acceleration > 0.0),
+            self.stylus_state_modeler_max_input_duration
+                .map_or(true, |max_duration| max_duration > 0.0),
+            self.stylus_state_modeler_max_input_distance
+                .map_or(true, |max_distance| max_distance > 0.0),
         ];
 
         let errors = vec![
@@ -128,7 +168,10 @@ impl ModelerParams {
             "`wobble_smoother_timeout` is not positive; ",
             "`wobble_smoother_speed_floor` is not positive; ",
             "`wobble_smoother_speed_ceiling` is not positive; ",
-            "`wobble_smoother_speed_floor` should be strictly smaller than `wobble_smoother_speed_ceiling`",
+            "`wobble_smoother_speed_floor` should be strictly smaller than `wobble_smoother_speed_ceiling`; ",
+            "`spike_filter_max_acceleration` is not positive; ",
+            "`stylus_state_modeler_max_input_duration` is not positive; ",
+            "`stylus_state_modeler_max_input_distance` is not positive; ",
         ];
 
         let tests_passed = parameter_tests.iter().fold(true, |acc, x| acc & x);
@@ -164,6 +207,9 @@ mod test_params {
             sampling_end_of_stroke_max_iterations: 0,
             sampling_max_outputs_per_call: 0,
             stylus_state_modeler_max_input_samples: 0,
+            spike_filter_max_acceleration: Some(-1.0),
+            stylus_state_modeler_max_input_duration: Some(-1.0),
+            stylus_state_modeler_max_input_distance: Some(0.0),
         })
         .validate();
         match s {
@@ -53,6 +53,8 @@ impl PositionModeler {
     /// update the model `n_steps` time between events
     /// this upsample between inputs linearly and applies
     /// these upstreamed events to the model
+    ///
+    /// The modeled states are appended to `out`
     pub(crate) fn update_along_linear_path(
         &mut self,
         start_pos: (f64, f64),
@@ -60,20 +62,19 @@ impl PositionModeler {
         end_pos: (f64, f64),
         end_time: f64,
         n_steps: i32,
-    ) -> Vec<ModelerPartial> {
-        (1..=n_steps)
-            .map(|i| {
-                let frac_adv = i as f64 / n_steps as f64;
-
-                let anchor_pos = (
-                    start_pos.0 + frac_adv * (end_pos.0 - start_pos.0),
-                    start_pos.1 + frac_adv * (end_pos.1 - start_pos.1),
-                );
-                let time = start_time + frac_adv * (end_time - start_time);
-
-                self.update(anchor_pos, time)
-            })
-            .collect()
+        out: &mut impl Extend<ModelerPartial>,
+    ) {
+        out.extend((1..=n_steps).map(|i| {
+            let frac_adv = i as f64 / n_steps as f64;
+
+            let anchor_pos = (
+                start_pos.0 + frac_adv * (end_pos.0 - start_pos.0),
+                start_pos.1 + frac_adv * (end_pos.1 - start_pos.1),
+            );
+            let time = start_time + frac_adv * (end_time - start_time);
+
+            self.update(anchor_pos, time)
+        }))
     }
 
     /// models the end of the stroke (catch-up) WITHOUT modifying the predictor
@@ -83,17 +84,19 @@ impl PositionModeler {
     /// but stops after `max_iterations`, if the distance between states is less
     /// than `stop_distance` or the candidate is close to the anchor (less than
     /// `stop_distance`)
+    ///
+    /// The candidates are appended to `out`
     pub(crate) fn model_end_of_stroke(
         &mut self,
         anchor_pos: (f64, f64),
         delta_time: f64,
         max_iterations: usize,
         stop_distance: f64,
-    ) -> Vec<ModelerPartial> {
+        out: &mut impl Extend<ModelerPartial>,
+    ) {
         let initial_state = self.state.clone();
         let mut delta_time = delta_time;
 
-        let mut out_events = Vec::<ModelerPartial>::with_capacity(max_iterations);
         for _ in 0..max_iterations {
             let previous_state = self.state.clone();
             let candidate = self.update(anchor_pos, previous_state.time + delta_time);
@@ -102,7 +105,7 @@ impl PositionModeler {
                 // reset the state
                 self.state = initial_state;
                 // stop, we aren't making progress anymore
-                return out_events;
+                return;
             }
 
             if nearest_point_on_segment(
@@ -116,18 +119,17 @@ impl PositionModeler {
                 self.state = previous_state;
                 continue;
             } else {
-                out_events.push(candidate.clone());
+                out.extend(Some(candidate.clone()));
             }
 
             if dist(candidate.pos, anchor_pos) < stop_distance {
                 // very close to the anchor, stopping iterations
                 // reset the state
                 self.state = initial_state;
-                return out_events;
+                return;
             }
         }
         self.state = initial_state;
-        out_events
     }
 }
 
@@ -446,7 +448,8 @@ fn test_update_linear_path() {
         },
     );
 
-    let linear_path = modeler.update_along_linear_path((5.0, 10.0), 3.0, (15., 10.), 3.05, 5);
+    let mut linear_path = Vec::new();
+    modeler.update_along_linear_path((5.0, 10.0), 3.0, (15., 10.), 3.05, 5, &mut linear_path);
     let expected = vec![
         ModelerPartial {
             pos: (5.5891, 10.0),
@@ -486,7 +489,15 @@ fn test_update_linear_path() {
         .fold(true, |acc, x| { acc && x.0.near(x.1) }));
 
     // second try
-    let linear_path_2 = modeler.update_along_linear_path((15.0, 10.0), 3.05, (15.0, 16.0), 3.08, 3);
+    let mut linear_path_2 = Vec::new();
+    modeler.update_along_linear_path(
+        (15.0, 10.0),
+        3.05,
+        (15.0, 16.0),
+        3.08,
+        3,
+        &mut linear_path_2,
+    );
     let expected2 = vec![
         ModelerPartial {
             pos: (13.4876, 10.5891),
@@ -524,7 +535,8 @@ fn model_end_of_stroke_stationary() {
         },
     );
 
-    let result = model.model_end_of_stroke((3.0, -1.0), 1. / 180., 20, 0.01);
+    let mut result = Vec::new();
+    model.model_end_of_stroke((3.0, -1.0), 1. / 180., 20, 0.01, &mut result);
     let expected = vec![
         ModelerPartial {
             pos: (3.9091, -1.9091),
@@ -608,7 +620,8 @@ fn end_of_stroke_motion() {
         },
     };
 
-    let result = model.model_end_of_stroke((7.0, 2.0), 1. / 120., 20, 0.01);
+    let mut result = Vec::new();
+    model.model_end_of_stroke((7.0, 2.0), 1. / 120., 20, 0.01, &mut result);
     let expected = vec![
         ModelerPartial {
             pos: (0.7697, 2.0333),
@@ -679,7 +692,8 @@ fn end_of_stroke_maxiters() {
         },
     };
 
-    let result = model.model_end_of_stroke((-9., -10.0), 0.0001, 10, 0.001);
+    let mut result = Vec::new();
+    model.model_end_of_stroke((-9., -10.0), 0.0001, 10, 0.001, &mut result);
     let expected = vec![
         ModelerPartial {
             pos: (7.9896, -3.0151),
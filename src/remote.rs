@@ -0,0 +1,348 @@
+//! Playout of remote strokes
+//!
+//! The raw inputs of a remote peer arrive in bursts because of network jitter. Modeling
+//! them as they arrive makes the remote ink stutter then catch up. [RemoteStrokeModeler]
+//! buffers them instead and replays them at their original cadence against the local
+//! clock, a playout delay after their remote time :
+//! - the delay adapts to the observed jitter. It is only lowered when a stroke starts so
+//!   that the cadence of a stroke is kept, and raised as soon as an input arrives late
+//! - each frame models at most [PlayoutConfig::max_inputs_per_frame] inputs, catching up
+//!   over several frames after a stall
+//! - while a stroke is in progress, the prediction covers the inputs that are not there yet
+use std::collections::VecDeque;
+
+use crate::{
+    ModelerError, ModelerInput, ModelerInputEventType, ModelerParams, ModelerResult, StrokeModeler,
+};
+
+/// Configuration of the playout of remote inputs
+///
+/// Durations are in the time unit of the inputs
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct PlayoutConfig {
+    /// lower bound of the playout delay
+    pub min_delay: f64,
+    /// upper bound of the playout delay
+    pub max_delay: f64,
+    /// the playout delay is this multiple of the estimated jitter
+    pub jitter_factor: f64,
+    /// maximum number of inputs modeled per frame
+    pub max_inputs_per_frame: usize,
+}
+
+impl PlayoutConfig {
+    /// [PlayoutConfig::min_delay] : 0.0,\
+    /// [PlayoutConfig::max_delay] : 0.25,\
+    /// [PlayoutConfig::jitter_factor] : 3.0,\
+    /// [PlayoutConfig::max_inputs_per_frame] : 8
+    pub fn suggested() -> Self {
+        Self {
+            min_delay: 0.0,
+            max_delay: 0.25,
+            jitter_factor: 3.0,
+            max_inputs_per_frame: 8,
+        }
+    }
+
+    fn validate(self) -> Result<Self, String> {
+        if !(self.min_delay >= 0.0 && self.max_delay >= self.min_delay) {
+            return Err(String::from(
+                "the playout delays should be positive with min_delay <= max_delay",
+            ));
+        }
+        if self.jitter_factor.is_nan() || self.jitter_factor < 0.0 {
+            return Err(String::from("the jitter factor should be positive"));
+        }
+        if self.max_inputs_per_frame == 0 {
+            return Err(String::from(
+                "at least one input should be modeled per frame",
+            ));
+        }
+        Ok(self)
+    }
+}
+
+/// Results to display for a frame
+#[derive(Debug, Default)]
+pub struct RemoteFrame {
+    /// results of the inputs played during the frame, same as [StrokeModeler::update]
+    pub committed: Vec<ModelerResult>,
+    /// prediction from the last played input, same as [StrokeModeler::predict]
+    pub predicted: Vec<ModelerResult>,
+    /// inputs rejected by the modeler during the frame, they are dropped
+    pub errors: Vec<(ModelerInput, ModelerError)>,
+}
+
+/// Models the inputs of a remote peer, see the [module documentation](self)
+pub struct RemoteStrokeModeler {
+    modeler: StrokeModeler,
+    config: PlayoutConfig,
+    /// received inputs not played yet, sorted by time
+    pending: VecDeque<ModelerInput>,
+    /// smallest observed difference between the arrival time and the remote time,
+    /// i.e. the clock offset plus the fastest transit time
+    base_transit: Option<f64>,
+    /// smoothed deviation of the transit times from `base_transit`
+    jitter: f64,
+    /// current playout delay
+    delay: f64,
+    /// remote time of the last played input
+    last_played: Option<f64>,
+    stroke_in_progress: bool,
+}
+
+impl RemoteStrokeModeler {
+    pub fn new(params: ModelerParams, config: PlayoutConfig) -> Result<Self, String> {
+        let config = config.validate()?;
+        Ok(Self {
+            modeler: StrokeModeler::new(params)?,
+            config,
+            pending: VecDeque::new(),
+            base_transit: None,
+            jitter: 0.0,
+            delay: config.min_delay,
+            last_played: None,
+            stroke_in_progress: false,
+        })
+    }
+
+    /// Registers an input received at the local time `arrival_time`
+    ///
+    /// Inputs can be received out of order. An input that is not later than the last
+    /// played one, or with the same time as a pending one (e.g. a retransmission),
+    /// is dropped
+    pub fn receive(&mut self, input: ModelerInput, arrival_time: f64) {
+        if self.last_played.map_or(false, |last| input.time <= last) {
+            return;
+        }
+        let index = self.pending.partition_point(|el| el.time < input.time);
+        if self
+            .pending
+            .get(index)
+            .map_or(false, |el| el.time == input.time)
+        {
+            return;
+        }
+        let transit = arrival_time - input.time;
+        let base_transit = self.base_transit.map_or(transit, |base| base.min(transit));
+        self.base_transit = Some(base_transit);
+        // same gain as the RTP interarrival jitter
+        let deviation = transit - base_transit;
+        self.jitter += (deviation - self.jitter) / 16.0;
+        // late input, raise the delay right away so that the next ones are not late too
+        if deviation > self.delay {
+            self.delay = deviation.min(self.config.max_delay);
+        }
+
+        self.pending.insert(index, input);
+    }
+
+    /// Models the inputs due at the local time `now` and returns the results to display
+    ///
+    /// An input rejected by the modeler is dropped and reported in [RemoteFrame::errors],
+    /// the playout goes on with the next inputs
+    pub fn frame(&mut self, now: f64) -> RemoteFrame {
+        let mut frame = RemoteFrame::default();
+        for _ in 0..self.config.max_inputs_per_frame {
+            let input = match self.pending.front() {
+                Some(input) => input,
+                None => break,
+            };
+            if input.event_type == ModelerInputEventType::Down && !self.stroke_in_progress {
+                // between strokes, the delay can follow the jitter down again
+                self.delay = self.target_delay();
+            }
+            if input.time + self.base_transit.unwrap_or(0.0) + self.delay > now {
+                break;
+            }
+            let input = self.pending.pop_front().unwrap();
+            self.last_played = Some(input.time);
+            match self
+                .modeler
+                .update_into(input.clone(), &mut frame.committed)
+            {
+                Ok(()) => {
+                    self.stroke_in_progress = input.event_type != ModelerInputEventType::Up;
+                }
+                Err(error) => frame.errors.push((input, error)),
+            }
+        }
+        if self.stroke_in_progress {
+            frame.predicted = self.modeler.predict().unwrap_or_default();
+        }
+        frame
+    }
+
+    /// current playout delay
+    pub fn playout_delay(&self) -> f64 {
+        self.delay
+    }
+
+    /// number of received inputs not played yet
+    pub fn pending(&self) -> usize {
+        self.pending.len()
+    }
+
+    fn target_delay(&self) -> f64 {
+        (self.config.jitter_factor * self.jitter)
+            .clamp(self.config.min_delay, self.config.max_delay)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::utils::test_stroke;
+
+    /// inputs along a circle
+    fn remote_stroke(start_time: f64, n_inputs: usize) -> Vec<ModelerInput> {
+        test_stroke(n_inputs, start_time, |i| {
+            let angle = 0.05 * i as f64;
+            (100.0 * angle.cos(), 100.0 * angle.sin())
+        })
+    }
+
+    /// channel with a 30 ms latency and up to 40 ms of jitter, inputs are sent in
+    /// packets of 4 and can arrive out of order
+    fn jittery_arrivals(inputs: &[ModelerInput]) -> Vec<(ModelerInput, f64)> {
+        let mut seed: u64 = 42;
+        let mut arrivals: Vec<(ModelerInput, f64)> = inputs
+            .chunks(4)
+            .flat_map(|packet| {
+                seed = seed
+                    .wrapping_mul(6364136223846793005)
+                    .wrapping_add(1442695040888963407);
+                let jitter = 0.04 * (seed >> 11) as f64 / (1u64 << 53) as f64;
+                let sent = packet.last().unwrap().time;
+                packet
+                    .iter()
+                    .map(move |input| (input.clone(), sent + 0.03 + jitter))
+            })
+            .collect();
+        arrivals.sort_by(|a, b| a.1.total_cmp(&b.1));
+        arrivals
+    }
+
+    #[test]
+    fn playout_smooths_jitter() {
+        let params = ModelerParams::suggested();
+        let config = PlayoutConfig::suggested();
+        let inputs: Vec<ModelerInput> = remote_stroke(0.0, 120)
+            .into_iter()
+            .chain(remote_stroke(0.7, 120))
+            .collect();
+        let arrivals = jittery_arrivals(&inputs);
+
+        let mut remote = RemoteStrokeModeler::new(params, config).unwrap();
+        let mut committed = Vec::new();
+        let mut next_arrival = 0;
+        // remote time of the last played input at each frame of the second stroke
+        let mut lags = Vec::new();
+        for frame_index in 1..120 {
+            let now = frame_index as f64 / 60.0;
+            while next_arrival < arrivals.len() && arrivals[next_arrival].1 <= now {
+                let (input, arrival) = arrivals[next_arrival].clone();
+                remote.receive(input, arrival);
+                next_arrival += 1;
+            }
+            let frame = remote.frame(now);
+            assert!(frame.errors.is_empty());
+            // bounded work per frame
+            assert!(frame.committed.len() <= config.max_inputs_per_frame * 4);
+            if let Some(last) = frame.committed.last() {
+                if last.time > 0.75 && last.time < 1.15 {
+                    lags.push(now - last.time);
+                }
+            }
+            committed.extend(frame.committed);
+        }
+        assert_eq!(remote.pending(), 0);
+
+        // the remote stroke is modeled the same as a local one
+        let mut modeler = StrokeModeler::new(params).unwrap();
+        let expected: Vec<ModelerResult> = inputs
+            .into_iter()
+            .flat_map(|input| modeler.update(input).unwrap())
+            .collect();
+        assert_eq!(committed, expected);
+
+        // the inputs are replayed at their cadence, the lag of the ink does not vary
+        // more than a frame and an input period, well below the 40 ms of jitter
+        assert!(lags.len() > 20);
+        let min = lags.iter().copied().fold(f64::INFINITY, f64::min);
+        let max = lags.iter().copied().fold(0.0, f64::max);
+        assert!(max - min < 1.0 / 60.0 + 1.0 / 240.0 + 1e-9);
+        assert!(remote.playout_delay() <= config.max_delay);
+    }
+
+    #[test]
+    fn burst_is_spread_over_frames() {
+        let config = PlayoutConfig {
+            max_inputs_per_frame: 4,
+            ..PlayoutConfig::suggested()
+        };
+        let mut remote = RemoteStrokeModeler::new(ModelerParams::suggested(), config).unwrap();
+        // the whole stroke arrives late at once
+        for input in remote_stroke(0.0, 12) {
+            remote.receive(input, 1.0);
+        }
+        let first = remote.frame(2.0);
+        assert_eq!(remote.pending(), 8);
+        assert!(!first.predicted.is_empty());
+        remote.frame(2.01);
+        remote.frame(2.02);
+        assert_eq!(remote.pending(), 0);
+        // no prediction once the stroke is over
+        assert!(remote.frame(2.03).predicted.is_empty());
+    }
+
+    #[test]
+    fn duplicates_and_errors_in_a_burst() {
+        let params = ModelerParams::suggested();
+        let inputs = remote_stroke(0.0, 12);
+        let mut remote = RemoteStrokeModeler::new(params, PlayoutConfig::suggested()).unwrap();
+        // retransmitted inputs, in the same burst and after being played
+        for input in inputs.iter().take(6).chain(inputs.iter().take(8)) {
+            remote.receive(input.clone(), 1.0);
+        }
+        assert_eq!(remote.pending(), 8);
+        let first = remote.frame(2.0);
+        assert!(first.errors.is_empty());
+        remote.receive(inputs[3].clone(), 2.0);
+        assert_eq!(remote.pending(), 0);
+
+        // an unexpected Down in the middle of the burst is dropped, the inputs played
+        // before and after it in the same frame are kept
+        let mut down = inputs[9].clone();
+        down.event_type = ModelerInputEventType::Down;
+        down.time += 0.001;
+        for input in inputs.iter().skip(8).chain(Some(&down)) {
+            remote.receive(input.clone(), 2.0);
+        }
+        let second = remote.frame(3.0);
+        assert_eq!(second.errors.len(), 1);
+        assert_eq!(second.errors[0].0, down);
+
+        let mut modeler = StrokeModeler::new(params).unwrap();
+        let expected: Vec<ModelerResult> = inputs
+            .into_iter()
+            .flat_map(|input| modeler.update(input).unwrap())
+            .collect();
+        let committed: Vec<ModelerResult> = first
+            .committed
+            .into_iter()
+            .chain(second.committed)
+            .collect();
+        assert_eq!(committed, expected);
+    }
+
+    #[test]
+    fn invalid_config() {
+        let config = PlayoutConfig {
+            min_delay: 0.5,
+            max_delay: 0.1,
+            ..PlayoutConfig::suggested()
+        };
+        assert!(RemoteStrokeModeler::new(ModelerParams::suggested(), config).is_err());
+    }
+}
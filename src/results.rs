@@ -1,3 +1,5 @@
+use crate::ModelerInput;
+
 /// result struct
 /// contains the position, time, presusre as well as the velocity and acceleration data
 #[derive(Debug, PartialEq)]
@@ -9,6 +11,60 @@ pub struct ModelerResult {
     pub pressure: f64,
 }
 
+/// Origin of the stroke-local frame : position and time of the `Down` event of the stroke
+///
+/// The modeler works internally relative to this origin, which keeps the precision
+/// of the positions on large canvases, far from the canvas origin
+#[derive(Debug, Clone, Copy, PartialEq, Default)]
+pub struct StrokeOrigin {
+    pub pos: (f64, f64),
+    pub time: f64,
+}
+
+impl StrokeOrigin {
+    /// convert an input from canvas coordinates to the stroke-local frame
+    pub(crate) fn to_local(self, input: ModelerInput) -> ModelerInput {
+        ModelerInput {
+            pos: (input.pos.0 - self.pos.0, input.pos.1 - self.pos.1),
+            time: input.time - self.time,
+            ..input
+        }
+    }
+
+    /// convert a result from the stroke-local frame to canvas coordinates
+    pub(crate) fn to_canvas(self, result: ModelerResult) -> ModelerResult {
+        ModelerResult {
+            pos: (result.pos.0 + self.pos.0, result.pos.1 + self.pos.1),
+            time: result.time + self.time,
+            ..result
+        }
+    }
+}
+
+/// A [ModelerResult] in the stroke-local frame, with single precision
+///
+/// Position and time are relative to the [StrokeOrigin] of the stroke
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct LocalModelerResult {
+    pub pos: (f32, f32),
+    pub velocity: (f32, f32),
+    pub acceleration: (f32, f32),
+    pub time: f32,
+    pub pressure: f32,
+}
+
+impl From<ModelerResult> for LocalModelerResult {
+    fn from(result: ModelerResult) -> Self {
+        Self {
+            pos: (result.pos.0 as f32, result.pos.1 as f32),
+            velocity: (result.velocity.0 as f32, result.velocity.1 as f32),
+            acceleration: (result.acceleration.0 as f32, result.acceleration.1 as f32),
+            time: result.time as f32,
+            pressure: result.pressure as f32,
+        }
+    }
+}
+
 /// A [ModelerResult] that does not have yet a pressure information
 #[derive(Clone, Debug)]
 pub(crate) struct ModelerPartial {
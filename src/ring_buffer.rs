@@ -0,0 +1,161 @@
+use allocator_api2::alloc::{Allocator, Global};
+use allocator_api2::vec::Vec;
+
+/// FIFO ring buffer whose storage lives in the given allocator
+///
+/// This replaces the `VecDeque`s used internally by the modeler, which can only
+/// use the global allocator. Only the operations the modeler needs are implemented.
+/// The buffer grows (doubling its capacity) when pushing onto a full buffer, but never
+/// shrinks, so that a modeler reused across strokes does not allocate anymore once
+/// warmed up
+pub(crate) struct RingBuffer<T, A: Allocator = Global> {
+    /// storage, `None` for unoccupied slots
+    buf: Vec<Option<T>, A>,
+    /// index of the front element in `buf`
+    head: usize,
+    /// number of elements in the buffer
+    len: usize,
+}
+
+impl<T> RingBuffer<T, Global> {
+    pub(crate) fn with_capacity(capacity: usize) -> Self {
+        Self::with_capacity_in(capacity, Global)
+    }
+}
+
+impl<T, A: Allocator + Clone> RingBuffer<T, A> {
+    pub(crate) fn with_capacity_in(capacity: usize, alloc: A) -> Self {
+        // at least one slot so that the index computations never divide by zero
+        let capacity = capacity.max(1);
+        let mut buf = Vec::with_capacity_in(capacity, alloc);
+        buf.resize_with(capacity, || None);
+        Self {
+            buf,
+            head: 0,
+            len: 0,
+        }
+    }
+
+    pub(crate) fn len(&self) -> usize {
+        self.len
+    }
+
+    #[allow(unused)]
+    pub(crate) fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// remove all elements, keeping the allocated storage
+    pub(crate) fn clear(&mut self) {
+        while self.pop_front().is_some() {}
+        self.head = 0;
+    }
+
+    pub(crate) fn push_back(&mut self, value: T) {
+        if self.len == self.buf.len() {
+            self.grow();
+        }
+        let index = self.physical_index(self.len);
+        self.buf[index] = Some(value);
+        self.len += 1;
+    }
+
+    pub(crate) fn pop_front(&mut self) -> Option<T> {
+        if self.len == 0 {
+            return None;
+        }
+        let value = self.buf[self.head].take();
+        self.head = (self.head + 1) % self.buf.len();
+        self.len -= 1;
+        value
+    }
+
+    pub(crate) fn front(&self) -> Option<&T> {
+        self.get(0)
+    }
+
+    pub(crate) fn back(&self) -> Option<&T> {
+        if self.len == 0 {
+            None
+        } else {
+            self.get(self.len - 1)
+        }
+    }
+
+    /// get the element at position `index` counted from the front
+    pub(crate) fn get(&self, index: usize) -> Option<&T> {
+        if index >= self.len {
+            return None;
+        }
+        self.buf[self.physical_index(index)].as_ref()
+    }
+
+    /// get a mutable reference to the element at position `index` counted from the front
+    pub(crate) fn get_mut(&mut self, index: usize) -> Option<&mut T> {
+        if index >= self.len {
+            return None;
+        }
+        let index = self.physical_index(index);
+        self.buf[index].as_mut()
+    }
+
+    /// iterate from the front to the back of the buffer
+    pub(crate) fn iter(&self) -> impl Iterator<Item = &T> + '_ {
+        (0..self.len).filter_map(move |i| self.get(i))
+    }
+
+    fn physical_index(&self, index: usize) -> usize {
+        (self.head + index) % self.buf.len()
+    }
+
+    /// double the capacity, moving the elements in order to the front of the new storage
+    fn grow(&mut self) {
+        let new_capacity = 2 * self.buf.len();
+        let mut new_buf = Vec::with_capacity_in(new_capacity, self.buf.allocator().clone());
+        while let Some(value) = self.pop_front() {
+            new_buf.push(Some(value));
+        }
+        self.len = new_buf.len();
+        new_buf.resize_with(new_capacity, || None);
+        self.buf = new_buf;
+        self.head = 0;
+    }
+}
+
+#[test]
+fn ring_buffer_fifo() {
+    let mut ring = RingBuffer::with_capacity(2);
+    assert!(ring.is_empty());
+    assert_eq!(ring.front(), None);
+    assert_eq!(ring.back(), None);
+
+    ring.push_back(1);
+    ring.push_back(2);
+    assert_eq!(ring.pop_front(), Some(1));
+    // wraps around
+    ring.push_back(3);
+    assert_eq!(ring.len(), 2);
+    assert_eq!(ring.front(), Some(&2));
+    assert_eq!(ring.back(), Some(&3));
+    assert_eq!(ring.get(1), Some(&3));
+    assert_eq!(ring.get(2), None);
+}
+
+#[test]
+fn ring_buffer_grow_keeps_order() {
+    let mut ring = RingBuffer::with_capacity(3);
+    ring.push_back(0);
+    ring.push_back(1);
+    assert_eq!(ring.pop_front(), Some(0));
+    for i in 2..10 {
+        ring.push_back(i);
+    }
+    assert_eq!(ring.len(), 9);
+    assert!(ring.iter().copied().eq(1..10));
+
+    ring.clear();
+    assert!(ring.is_empty());
+    ring.push_back(42);
+    assert_eq!(ring.front(), Some(&42));
+    assert_eq!(ring.back(), Some(&42));
+}
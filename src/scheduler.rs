@@ -0,0 +1,288 @@
+//! Scheduling of the modeling work of several strokes
+//!
+//! A [Scheduler] owns a pool of [StrokeModeler]s, each with a [Priority]. Inputs are queued
+//! with [Scheduler::push] and modeled on [Scheduler::run_frame] :
+//! - [Priority::Interactive] inputs and predictions (the local pen) are always processed
+//!   first and in full, so their latency does not depend on the other strokes
+//! - then the queued inputs of the other classes, in priority then arrival order,
+//!   as long as the frame budget is not exhausted. The remaining inputs are deferred to the
+//!   next frames
+//! - last, the predictions of the other classes, if the budget allows. A deferred prediction
+//!   is kept if the modeler has not changed, cleared otherwise
+use std::collections::VecDeque;
+use std::time::{Duration, Instant};
+
+use crate::{ModelerError, ModelerInput, ModelerParams, ModelerResult, StrokeModeler};
+
+/// Priority class of a modeler
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub enum Priority {
+    /// the local pen, never deferred
+    Interactive,
+    /// remote peers
+    Remote,
+    /// replayed or remodeled strokes
+    Background,
+}
+
+impl Priority {
+    /// classes that can be deferred, in priority order
+    const DEFERRABLE: [Priority; 2] = [Priority::Remote, Priority::Background];
+}
+
+/// Identifier of a modeler of a [Scheduler]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct ModelerId(usize);
+
+/// What happened during a [Scheduler::run_frame]
+#[derive(Debug, Default)]
+pub struct FrameReport {
+    /// time spent on the interactive class, at the start of the frame
+    pub interactive_time: Duration,
+    /// number of inputs modeled
+    pub modeled: usize,
+    /// number of queued inputs deferred to the next frames
+    pub deferred: usize,
+    /// number of predictions deferred to the next frames
+    pub deferred_predictions: usize,
+    /// inputs rejected by their modeler
+    pub errors: Vec<(ModelerId, ModelerError)>,
+}
+
+struct Slot {
+    modeler: StrokeModeler,
+    priority: Priority,
+    /// results of the modeled inputs not taken yet
+    results: Vec<ModelerResult>,
+    prediction: Vec<ModelerResult>,
+    /// whether inputs were modeled since the last prediction
+    changed: bool,
+}
+
+/// Pool of modelers sharing a per-frame time budget, see the [module documentation](self)
+#[derive(Default)]
+pub struct Scheduler {
+    slots: Vec<Slot>,
+    /// queued inputs of the interactive class
+    interactive: VecDeque<(ModelerId, ModelerInput)>,
+    /// queued inputs of the deferrable classes, in the order of [Priority::DEFERRABLE]
+    deferrable: [VecDeque<(ModelerId, ModelerInput)>; 2],
+}
+
+impl Scheduler {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Adds a modeler to the pool
+    pub fn add_modeler(
+        &mut self,
+        params: ModelerParams,
+        priority: Priority,
+    ) -> Result<ModelerId, String> {
+        self.slots.push(Slot {
+            modeler: StrokeModeler::new(params)?,
+            priority,
+            results: Vec::new(),
+            prediction: Vec::new(),
+            changed: false,
+        });
+        Ok(ModelerId(self.slots.len() - 1))
+    }
+
+    /// Queues an input for the modeler `id`
+    ///
+    /// Panics if `id` does not come from this scheduler
+    pub fn push(&mut self, id: ModelerId, input: ModelerInput) {
+        match self.slots[id.0].priority {
+            Priority::Interactive => self.interactive.push_back((id, input)),
+            priority => {
+                let class = Priority::DEFERRABLE
+                    .iter()
+                    .position(|&deferrable| deferrable == priority)
+                    .unwrap();
+                self.deferrable[class].push_back((id, input));
+            }
+        }
+    }
+
+    /// number of queued inputs, of all classes
+    pub fn queued(&self) -> usize {
+        self.interactive.len() + self.deferrable.iter().map(VecDeque::len).sum::<usize>()
+    }
+
+    /// Takes the results of the inputs of the modeler `id` modeled so far
+    pub fn take_results(&mut self, id: ModelerId) -> Vec<ModelerResult> {
+        std::mem::take(&mut self.slots[id.0].results)
+    }
+
+    /// The last prediction of the modeler `id`, empty if no stroke is in progress
+    /// or the prediction was deferred after new inputs
+    pub fn prediction(&self, id: ModelerId) -> &[ModelerResult] {
+        &self.slots[id.0].prediction
+    }
+
+    /// Runs the work of a frame, spending at most `budget` on the deferrable classes
+    /// after the interactive class (which is never deferred), however long the
+    /// interactive work took
+    pub fn run_frame(&mut self, budget: Duration) -> FrameReport {
+        let start = Instant::now();
+        self.run_frame_with(budget, || start.elapsed())
+    }
+
+    /// [Scheduler::run_frame] with the time spent in the frame given by `elapsed`
+    fn run_frame_with(
+        &mut self,
+        budget: Duration,
+        mut elapsed: impl FnMut() -> Duration,
+    ) -> FrameReport {
+        let mut report = FrameReport::default();
+
+        while let Some((id, input)) = self.interactive.pop_front() {
+            Self::model(&mut self.slots[id.0], id, input, &mut report);
+        }
+        for slot in self
+            .slots
+            .iter_mut()
+            .filter(|slot| slot.priority == Priority::Interactive && slot.changed)
+        {
+            Self::predict(slot);
+        }
+        report.interactive_time = elapsed();
+        // the budget starts after the interactive work
+        let deadline = report.interactive_time + budget;
+
+        for queue in self.deferrable.iter_mut() {
+            while !queue.is_empty() && elapsed() < deadline {
+                let (id, input) = queue.pop_front().unwrap();
+                Self::model(&mut self.slots[id.0], id, input, &mut report);
+            }
+            report.deferred += queue.len();
+        }
+        for priority in Priority::DEFERRABLE {
+            for slot in self
+                .slots
+                .iter_mut()
+                .filter(|slot| slot.priority == priority && slot.changed)
+            {
+                if elapsed() < deadline {
+                    Self::predict(slot);
+                } else {
+                    // outdated by the new inputs
+                    slot.prediction.clear();
+                    report.deferred_predictions += 1;
+                }
+            }
+        }
+        report
+    }
+
+    fn model(slot: &mut Slot, id: ModelerId, input: ModelerInput, report: &mut FrameReport) {
+        match slot.modeler.update_into(input, &mut slot.results) {
+            Ok(()) => {
+                report.modeled += 1;
+                slot.changed = true;
+            }
+            Err(error) => report.errors.push((id, error)),
+        }
+    }
+
+    fn predict(slot: &mut Slot) {
+        slot.prediction.clear();
+        // fails when no stroke is in progress, the prediction is empty then
+        let _ = slot.modeler.predict_into(&mut slot.prediction);
+        slot.changed = false;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::utils::{test_stroke, ticking_clock};
+
+    /// the tests push at most 20 inputs, the strokes do not end
+    fn stroke() -> Vec<ModelerInput> {
+        test_stroke(21, 0.0, |i| (0.1 * i as f64, 0.05 * i as f64))
+    }
+
+    #[test]
+    fn interactive_is_never_deferred() {
+        let params = ModelerParams::suggested();
+        let mut scheduler = Scheduler::new();
+        let background = scheduler.add_modeler(params, Priority::Background).unwrap();
+        let remote = scheduler.add_modeler(params, Priority::Remote).unwrap();
+        let pen = scheduler
+            .add_modeler(params, Priority::Interactive)
+            .unwrap();
+        let stroke = stroke();
+        for input in &stroke[..20] {
+            scheduler.push(background, input.clone());
+        }
+        for input in &stroke[..3] {
+            scheduler.push(remote, input.clone());
+        }
+        for input in &stroke[..4] {
+            scheduler.push(pen, input.clone());
+        }
+
+        let report = scheduler.run_frame_with(Duration::from_millis(5), ticking_clock());
+        // all the pen inputs, then the remote ones first
+        assert_eq!(scheduler.take_results(pen).len(), 4);
+        assert!(!scheduler.prediction(pen).is_empty());
+        assert_eq!(report.modeled, 4 + 3 + 1);
+        assert_eq!(report.deferred, 19);
+        assert_eq!(report.deferred_predictions, 2);
+        assert!(scheduler.prediction(remote).is_empty());
+
+        // the background work is spread over the next frames
+        let mut frames = 1;
+        while scheduler.queued() > 0 {
+            let report = scheduler.run_frame_with(Duration::from_millis(5), ticking_clock());
+            assert!(report.modeled <= 4);
+            frames += 1;
+        }
+        assert_eq!(frames, 6);
+        assert_eq!(scheduler.take_results(background).len(), 20);
+        // enough budget for the predictions now
+        scheduler.run_frame_with(Duration::from_millis(5), ticking_clock());
+        assert!(!scheduler.prediction(background).is_empty());
+        assert!(!scheduler.prediction(remote).is_empty());
+    }
+
+    #[test]
+    fn budget_starts_after_interactive() {
+        let params = ModelerParams::suggested();
+        let mut scheduler = Scheduler::new();
+        let background = scheduler.add_modeler(params, Priority::Background).unwrap();
+        let pen = scheduler
+            .add_modeler(params, Priority::Interactive)
+            .unwrap();
+        let stroke = stroke();
+        for input in &stroke[..20] {
+            scheduler.push(background, input.clone());
+        }
+        scheduler.push(pen, stroke[0].clone());
+
+        // the interactive work takes longer than the budget
+        let mut clock = ticking_clock();
+        let heavy_interactive = move || clock() + Duration::from_millis(10);
+        let report = scheduler.run_frame_with(Duration::from_millis(6), heavy_interactive);
+        assert_eq!(report.interactive_time, Duration::from_millis(11));
+        assert_eq!(report.modeled, 1 + 5);
+        assert_eq!(report.deferred, 15);
+    }
+
+    #[test]
+    fn errors_are_reported() {
+        let mut scheduler = Scheduler::new();
+        let pen = scheduler
+            .add_modeler(ModelerParams::suggested(), Priority::Interactive)
+            .unwrap();
+        // no Down
+        scheduler.push(pen, stroke()[1].clone());
+        let report = scheduler.run_frame(Duration::from_millis(6));
+        assert_eq!(report.errors.len(), 1);
+        assert_eq!(report.errors[0].0, pen);
+        assert!(scheduler.prediction(pen).is_empty());
+    }
+}
@@ -0,0 +1,566 @@
+//! Shared-memory ring buffers to exchange inputs and results with another process
+//!
+//! When the input broker and the renderer live in different processes, serializing each
+//! [ModelerInput] over a socket costs a syscall and copies per event. Instead, the broker
+//! can push fixed-layout [InputRecord]s into a single-producer/single-consumer [ShmRing]
+//! backed by a `memfd`, which the modeler drains in batches with [update_from_ring].
+//! Results can be sent back the same way through a ring of [ResultRecord]s with [RingWriter].
+//!
+//! The memory file descriptor is shared with the other process either by inheritance or over
+//! a unix socket (`SCM_RIGHTS`), and mapped there with [ShmRing::open].
+//!
+//! Only available on Linux, with the `shm` feature
+use crate::engine::StrokeModeler;
+use crate::{ModelerError, ModelerInput, ModelerInputEventType, ModelerResult};
+use allocator_api2::alloc::Allocator;
+use std::io;
+use std::marker::PhantomData;
+use std::os::unix::io::RawFd;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Plain-old-data record that can be stored in a [ShmRing]
+///
+/// # Safety
+///
+/// The type must be `#[repr(C)]`, contain no pointers and be valid for any bit pattern,
+/// as its content is written by another process
+pub unsafe trait Record: Copy + 'static {}
+
+/// Fixed-layout version of [ModelerInput] (40 bytes)
+#[derive(Debug, Clone, Copy, PartialEq)]
+#[repr(C)]
+pub struct InputRecord {
+    pub time: f64,
+    pub x: f64,
+    pub y: f64,
+    pub pressure: f64,
+    /// 0 for [ModelerInputEventType::Down], 1 for [ModelerInputEventType::Move]
+    /// and 2 for [ModelerInputEventType::Up]
+    pub event_type: u32,
+    pub _padding: u32,
+}
+
+unsafe impl Record for InputRecord {}
+
+impl From<&ModelerInput> for InputRecord {
+    fn from(input: &ModelerInput) -> Self {
+        Self {
+            time: input.time,
+            x: input.pos.0,
+            y: input.pos.1,
+            pressure: input.pressure,
+            event_type: match input.event_type {
+                ModelerInputEventType::Down => 0,
+                ModelerInputEventType::Move => 1,
+                ModelerInputEventType::Up => 2,
+            },
+            _padding: 0,
+        }
+    }
+}
+
+impl TryFrom<InputRecord> for ModelerInput {
+    type Error = String;
+
+    fn try_from(record: InputRecord) -> Result<Self, Self::Error> {
+        Ok(Self {
+            event_type: match record.event_type {
+                0 => ModelerInputEventType::Down,
+                1 => ModelerInputEventType::Move,
+                2 => ModelerInputEventType::Up,
+                other => return Err(format!("invalid event type {other}")),
+            },
+            pos: (record.x, record.y),
+            time: record.time,
+            pressure: record.pressure,
+        })
+    }
+}
+
+/// Fixed-layout version of [ModelerResult] (64 bytes)
+#[derive(Debug, Clone, Copy, PartialEq)]
+#[repr(C)]
+pub struct ResultRecord {
+    pub pos: [f64; 2],
+    pub velocity: [f64; 2],
+    pub acceleration: [f64; 2],
+    pub time: f64,
+    pub pressure: f64,
+}
+
+unsafe impl Record for ResultRecord {}
+
+impl From<&ModelerResult> for ResultRecord {
+    fn from(result: &ModelerResult) -> Self {
+        Self {
+            pos: [result.pos.0, result.pos.1],
+            velocity: [result.velocity.0, result.velocity.1],
+            acceleration: [result.acceleration.0, result.acceleration.1],
+            time: result.time,
+            pressure: result.pressure,
+        }
+    }
+}
+
+impl From<ResultRecord> for ModelerResult {
+    fn from(record: ResultRecord) -> Self {
+        Self {
+            pos: (record.pos[0], record.pos[1]),
+            velocity: (record.velocity[0], record.velocity[1]),
+            acceleration: (record.acceleration[0], record.acceleration[1]),
+            time: record.time,
+            pressure: record.pressure,
+        }
+    }
+}
+
+/// identifies the memory as a ring created by this crate
+const RING_MAGIC: u64 = 0x494e_4b52_494e_4731;
+
+/// header at the start of the shared memory, the producer and consumer
+/// indices are on separate cache lines
+#[repr(C)]
+struct RingHeader {
+    magic: u64,
+    record_size: u64,
+    capacity: u64,
+    _padding_0: [u64; 5],
+    /// number of records pushed since the creation, written by the producer
+    head: AtomicU64,
+    _padding_1: [u64; 7],
+    /// number of records popped since the creation, written by the consumer
+    tail: AtomicU64,
+    _padding_2: [u64; 7],
+}
+
+const HEADER_SIZE: usize = std::mem::size_of::<RingHeader>();
+
+/// Single-producer/single-consumer ring of records in shared memory
+///
+/// One process (or thread) pushes records, the other pops them. Pushing and popping
+/// only involve atomic loads and stores on the shared indices, and no syscall.
+pub struct ShmRing<T: Record> {
+    fd: RawFd,
+    map: *mut u8,
+    map_len: usize,
+    capacity: u64,
+    _record: PhantomData<T>,
+}
+
+// the mapping is owned by the ring and only accessed following the SPSC protocol
+unsafe impl<T: Record> Send for ShmRing<T> {}
+
+impl<T: Record> ShmRing<T> {
+    /// Creates a ring in a new memory file, with room for `capacity` records
+    /// (rounded up to a power of two)
+    ///
+    /// The file descriptor is created with `FD_CLOEXEC`
+    pub fn create(capacity: usize) -> io::Result<Self> {
+        let capacity = capacity.max(1).next_power_of_two();
+        let map_len = HEADER_SIZE + capacity * std::mem::size_of::<T>();
+
+        let name = b"ink-stroke-modeler-ring\0";
+        let fd =
+            unsafe { libc::memfd_create(name.as_ptr() as *const libc::c_char, libc::MFD_CLOEXEC) };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        if unsafe { libc::ftruncate(fd, map_len as libc::off_t) } < 0 {
+            let error = io::Error::last_os_error();
+            unsafe { libc::close(fd) };
+            return Err(error);
+        }
+        let mut ring = unsafe { Self::map(fd, map_len)? };
+
+        // the memory file is zero-initialized, so are the indices
+        let header = ring.map as *mut RingHeader;
+        unsafe {
+            (*header).magic = RING_MAGIC;
+            (*header).record_size = std::mem::size_of::<T>() as u64;
+            (*header).capacity = capacity as u64;
+        }
+        ring.capacity = capacity as u64;
+        Ok(ring)
+    }
+
+    /// Maps a ring created by [ShmRing::create] in another process, taking
+    /// ownership of the file descriptor
+    ///
+    /// # Safety
+    ///
+    /// `fd` must be an open file descriptor owned by the caller, and the other side
+    /// must only push (resp. pop) records while this side only pops (resp. pushes)
+    pub unsafe fn open(fd: RawFd) -> io::Result<Self> {
+        let mut stat: libc::stat = std::mem::zeroed();
+        if libc::fstat(fd, &mut stat) < 0 {
+            let error = io::Error::last_os_error();
+            libc::close(fd);
+            return Err(error);
+        }
+        let map_len = stat.st_size as usize;
+        if map_len < HEADER_SIZE {
+            libc::close(fd);
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "the memory file is too small",
+            ));
+        }
+        let mut ring = Self::map(fd, map_len)?;
+
+        let header = ring.header();
+        let capacity = header.capacity;
+        // the header is written by the other process, the length must not overflow
+        let expected_len = capacity
+            .checked_mul(header.record_size)
+            .and_then(|records_len| records_len.checked_add(HEADER_SIZE as u64));
+        if header.magic != RING_MAGIC
+            || header.record_size != std::mem::size_of::<T>() as u64
+            || !capacity.is_power_of_two()
+            || expected_len != Some(map_len as u64)
+        {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "the memory file is not a ring of this record type",
+            ));
+        }
+        ring.capacity = capacity;
+        Ok(ring)
+    }
+
+    /// map the memory file, the ring is returned with a capacity of 0
+    unsafe fn map(fd: RawFd, map_len: usize) -> io::Result<Self> {
+        let map = libc::mmap(
+            std::ptr::null_mut(),
+            map_len,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_SHARED,
+            fd,
+            0,
+        );
+        if map == libc::MAP_FAILED {
+            let error = io::Error::last_os_error();
+            libc::close(fd);
+            return Err(error);
+        }
+        Ok(Self {
+            fd,
+            map: map as *mut u8,
+            map_len,
+            capacity: 0,
+            _record: PhantomData,
+        })
+    }
+
+    /// The file descriptor of the memory file, to share it with the other process
+    pub fn fd(&self) -> RawFd {
+        self.fd
+    }
+
+    /// maximum number of records in the ring
+    pub fn capacity(&self) -> usize {
+        self.capacity as usize
+    }
+
+    /// number of records currently in the ring
+    pub fn len(&self) -> usize {
+        let header = self.header();
+        let head = header.head.load(Ordering::Acquire);
+        let tail = header.tail.load(Ordering::Acquire);
+        head.wrapping_sub(tail).min(self.capacity) as usize
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Pushes a record, returns `false` if the ring is full
+    ///
+    /// Only to be called on the producer side
+    pub fn push(&mut self, record: T) -> bool {
+        self.push_slice(std::slice::from_ref(&record)) == 1
+    }
+
+    /// Pushes as many records from `records` as there is room for, and
+    /// returns the number of records pushed
+    ///
+    /// Only to be called on the producer side
+    pub fn push_slice(&mut self, records: &[T]) -> usize {
+        let header = self.header();
+        let head = header.head.load(Ordering::Relaxed);
+        let tail = header.tail.load(Ordering::Acquire);
+        let free = self.capacity - head.wrapping_sub(tail).min(self.capacity);
+        let count = (records.len() as u64).min(free);
+
+        for (i, record) in records.iter().take(count as usize).enumerate() {
+            unsafe { self.slot(head.wrapping_add(i as u64)).write(*record) };
+        }
+        header
+            .head
+            .store(head.wrapping_add(count), Ordering::Release);
+        count as usize
+    }
+
+    /// Pops up to `max` records, passing them to `f` in order until it returns an error.
+    /// The record for which `f` failed is popped as well.
+    ///
+    /// Returns the number of records popped, the shared index being written once per call.
+    /// On an error, the number of records popped (including the failed one) is returned
+    /// with it. Only to be called on the consumer side
+    pub fn pop_with<E>(
+        &mut self,
+        max: usize,
+        mut f: impl FnMut(T) -> Result<(), E>,
+    ) -> Result<usize, (usize, E)> {
+        let header = self.header();
+        let tail = header.tail.load(Ordering::Relaxed);
+        let head = header.head.load(Ordering::Acquire);
+        let available = head.wrapping_sub(tail).min(self.capacity).min(max as u64);
+
+        let mut popped = 0;
+        let mut result = Ok(());
+        while popped < available && result.is_ok() {
+            let record = unsafe { self.slot(tail.wrapping_add(popped)).read() };
+            popped += 1;
+            result = f(record);
+        }
+        header
+            .tail
+            .store(tail.wrapping_add(popped), Ordering::Release);
+        result
+            .map(|_| popped as usize)
+            .map_err(|error| (popped as usize, error))
+    }
+
+    fn header(&self) -> &RingHeader {
+        unsafe { &*(self.map as *const RingHeader) }
+    }
+
+    /// pointer to the slot of the record of index `index`
+    fn slot(&self, index: u64) -> *mut T {
+        let slot = (index & (self.capacity - 1)) as usize;
+        unsafe { (self.map.add(HEADER_SIZE) as *mut T).add(slot) }
+    }
+}
+
+impl<T: Record> Drop for ShmRing<T> {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.map as *mut libc::c_void, self.map_len);
+            libc::close(self.fd);
+        }
+    }
+}
+
+/// Pushes the results extended into it to a ring of [ResultRecord]s,
+/// counting the results that did not fit
+pub struct RingWriter<'a> {
+    ring: &'a mut ShmRing<ResultRecord>,
+    /// number of results dropped because the ring was full
+    pub dropped: usize,
+}
+
+impl<'a> RingWriter<'a> {
+    pub fn new(ring: &'a mut ShmRing<ResultRecord>) -> Self {
+        Self { ring, dropped: 0 }
+    }
+}
+
+impl<'a> Extend<ModelerResult> for RingWriter<'a> {
+    fn extend<I: IntoIterator<Item = ModelerResult>>(&mut self, iter: I) {
+        for result in iter {
+            if !self.ring.push(ResultRecord::from(&result)) {
+                self.dropped += 1;
+            }
+        }
+    }
+}
+
+/// Error of [update_from_ring]
+#[derive(Debug, Clone, thiserror::Error)]
+#[error("input record {} of the batch rejected", .consumed - 1)]
+pub struct RingUpdateError {
+    /// number of input records consumed, the rejected one included. The ones before it
+    /// were modeled
+    pub consumed: usize,
+    #[source]
+    pub error: ModelerError,
+}
+
+/// Models up to `max_inputs` input records from `inputs`, appending the results to `out`
+/// (a [RingWriter] to send them back to the other process)
+///
+/// Returns the number of inputs consumed. Modeling stops at the first input that
+/// is rejected (or whose event type is invalid), this input is consumed as well
+/// and the error holds the number of inputs consumed
+pub fn update_from_ring<A: Allocator + Clone>(
+    modeler: &mut StrokeModeler<A>,
+    inputs: &mut ShmRing<InputRecord>,
+    max_inputs: usize,
+    out: &mut impl Extend<ModelerResult>,
+) -> Result<usize, RingUpdateError> {
+    inputs
+        .pop_with(max_inputs, |record| {
+            let input = ModelerInput::try_from(record).map_err(|_| ModelerError::InvalidRecord)?;
+            modeler.update_into(input, out)
+        })
+        .map_err(|(consumed, error)| RingUpdateError { consumed, error })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::utils::test_stroke;
+    use crate::ModelerParams;
+
+    /// environment variable holding the file descriptor of the ring in the child process
+    const CHILD_FD_VAR: &str = "INK_STROKE_MODELER_SHM_TEST_FD";
+
+    fn stroke() -> Vec<ModelerInput> {
+        test_stroke(50, 0.0, |i| {
+            ((i as f64 * 0.1).cos(), (i as f64 * 0.1).sin())
+        })
+    }
+
+    #[test]
+    fn record_layouts() {
+        assert_eq!(std::mem::size_of::<InputRecord>(), 40);
+        assert_eq!(std::mem::size_of::<ResultRecord>(), 64);
+        assert_eq!(HEADER_SIZE, 192);
+
+        let input = stroke()[3].clone();
+        assert_eq!(ModelerInput::try_from(InputRecord::from(&input)), Ok(input));
+        let invalid = InputRecord {
+            event_type: 3,
+            ..InputRecord::from(&ModelerInput::default())
+        };
+        assert!(ModelerInput::try_from(invalid).is_err());
+    }
+
+    #[test]
+    fn ring_wraps_and_fills() {
+        let mut ring = ShmRing::<InputRecord>::create(3).unwrap();
+        assert_eq!(ring.capacity(), 4);
+        let records: Vec<InputRecord> = stroke().iter().map(InputRecord::from).collect();
+
+        let mut popped = Vec::new();
+        let mut pushed = 0;
+        while popped.len() < records.len() {
+            pushed += ring.push_slice(&records[pushed..]);
+            assert!(ring.len() <= 4);
+            ring.pop_with(3, |record| {
+                popped.push(record);
+                Ok::<(), ()>(())
+            })
+            .unwrap();
+        }
+        assert_eq!(popped, records);
+        assert!(ring.is_empty());
+    }
+
+    #[test]
+    fn consumed_count_on_error() {
+        let mut inputs = ShmRing::<InputRecord>::create(16).unwrap();
+        let mut records: Vec<InputRecord> =
+            stroke().iter().take(8).map(InputRecord::from).collect();
+        records[3].event_type = 7;
+        assert_eq!(inputs.push_slice(&records), 8);
+
+        let mut modeler = StrokeModeler::new(ModelerParams::suggested()).unwrap();
+        let mut results = Vec::new();
+        let error = update_from_ring(&mut modeler, &mut inputs, 16, &mut results).unwrap_err();
+        assert_eq!(error.consumed, 4);
+        assert!(matches!(error.error, ModelerError::InvalidRecord));
+        // the 3 inputs before the invalid one were modeled
+        let mut reference = StrokeModeler::new(ModelerParams::suggested()).unwrap();
+        let expected: Vec<ModelerResult> = stroke()
+            .into_iter()
+            .take(3)
+            .flat_map(|input| reference.update(input).unwrap())
+            .collect();
+        assert_eq!(results, expected);
+        assert_eq!(inputs.len(), 4);
+    }
+
+    #[test]
+    fn huge_capacity_rejected() {
+        // 2^61 records of 40 bytes wrap to 0 bytes, the header alone would match
+        for capacity in [1 << 61, 1 << 62] {
+            let ring = ShmRing::<InputRecord>::create(1).unwrap();
+            unsafe {
+                (*(ring.map as *mut RingHeader)).capacity = capacity;
+                assert_eq!(libc::ftruncate(ring.fd(), HEADER_SIZE as libc::off_t), 0);
+                let fd = libc::dup(ring.fd());
+                assert!(fd >= 0);
+                let error = ShmRing::<InputRecord>::open(fd).err().unwrap();
+                assert_eq!(error.kind(), io::ErrorKind::InvalidData);
+            }
+        }
+    }
+
+    /// producer side of `two_processes`, only runs in the child process
+    #[test]
+    fn child_producer() {
+        let fd: RawFd = match std::env::var(CHILD_FD_VAR) {
+            Ok(fd) => fd.parse().unwrap(),
+            Err(_) => return,
+        };
+        let mut ring = unsafe { ShmRing::<InputRecord>::open(fd) }.unwrap();
+        for input in stroke() {
+            while !ring.push(InputRecord::from(&input)) {
+                std::thread::yield_now();
+            }
+        }
+    }
+
+    #[test]
+    fn two_processes() {
+        // smaller than the stroke, so that the producer has to wait for the consumer
+        let mut inputs = ShmRing::<InputRecord>::create(8).unwrap();
+        let mut results = ShmRing::<ResultRecord>::create(1024).unwrap();
+        // let the child process inherit the file descriptor
+        assert!(unsafe { libc::fcntl(inputs.fd(), libc::F_SETFD, 0) } >= 0);
+
+        let mut child = std::process::Command::new(std::env::current_exe().unwrap())
+            .args(["--exact", "shm::tests::child_producer", "--quiet"])
+            .env(CHILD_FD_VAR, inputs.fd().to_string())
+            .stdout(std::process::Stdio::null())
+            .spawn()
+            .unwrap();
+
+        let mut modeler = StrokeModeler::new(ModelerParams::suggested()).unwrap();
+        let mut writer = RingWriter::new(&mut results);
+        let mut consumed = 0;
+        let deadline = std::time::Instant::now() + std::time::Duration::from_secs(30);
+        while consumed < stroke().len() {
+            consumed += update_from_ring(&mut modeler, &mut inputs, 4, &mut writer).unwrap();
+            // the child exited without sending the whole stroke
+            if let Some(status) = child.try_wait().unwrap() {
+                assert!(
+                    consumed + inputs.len() >= stroke().len(),
+                    "the producer exited early ({status})"
+                );
+            }
+            if std::time::Instant::now() > deadline {
+                let _ = child.kill();
+                panic!("timed out waiting for the producer");
+            }
+            std::thread::yield_now();
+        }
+        assert_eq!(writer.dropped, 0);
+        assert!(child.wait().unwrap().success());
+
+        let mut reference = StrokeModeler::new(ModelerParams::suggested()).unwrap();
+        let expected: Vec<ModelerResult> = stroke()
+            .into_iter()
+            .flat_map(|input| reference.update(input).unwrap())
+            .collect();
+        let mut received = Vec::new();
+        results
+            .pop_with(usize::MAX, |record| {
+                received.push(ModelerResult::from(record));
+                Ok::<(), ()>(())
+            })
+            .unwrap();
+        assert_eq!(received, expected);
+    }
+}
@@ -0,0 +1,113 @@
+use crate::utils::dist;
+use crate::ModelerInput;
+
+/// Rejects single-sample position spikes emitted by some digitizers
+///
+/// A raw input is suspicious if the speed increase it implies relative to the
+/// previous accepted input is larger than `max_acceleration`. Suspicious inputs are held
+/// back for one sample : if the next input is plausible with respect to the last accepted
+/// input, the held input was an isolated spike and is dropped, otherwise the jump is
+/// confirmed and the held input is modeled after all.
+///
+/// This costs a constant amount of work per input, and only adds a latency of
+/// one sample, for suspicious inputs only
+pub(crate) struct SpikeFilter {
+    /// maximum plausible acceleration (increase in speed per unit time)
+    max_acceleration: f64,
+    /// position and time of the last accepted input
+    last: Option<((f64, f64), f64)>,
+    /// speed between the two last accepted inputs
+    last_speed: f64,
+    /// input held back for one sample because it may be a spike
+    pub(crate) held: Option<ModelerInput>,
+}
+
+impl SpikeFilter {
+    pub(crate) fn new(max_acceleration: f64) -> Self {
+        Self {
+            max_acceleration,
+            last: None,
+            last_speed: 0.0,
+            held: None,
+        }
+    }
+
+    /// clear the filter state, to be called on a new stroke
+    pub(crate) fn reset(&mut self) {
+        self.last = None;
+        self.last_speed = 0.0;
+        self.held = None;
+    }
+
+    /// whether the input is plausible with respect to the last accepted input
+    ///
+    /// inputs with no time difference to the last accepted one can't be checked
+    /// and are considered plausible
+    pub(crate) fn is_plausible(&self, input: &ModelerInput) -> bool {
+        match self.last {
+            None => true,
+            Some((pos, time)) => {
+                let delta_time = input.time - time;
+                if delta_time <= 0.0 {
+                    return true;
+                }
+                let speed = dist(pos, input.pos) / delta_time;
+                (speed - self.last_speed) / delta_time <= self.max_acceleration
+            }
+        }
+    }
+
+    /// register an input that has been passed on to the modeler
+    pub(crate) fn accept(&mut self, input: &ModelerInput) {
+        if let Some((pos, time)) = self.last {
+            let delta_time = input.time - time;
+            if delta_time > 0.0 {
+                self.last_speed = dist(pos, input.pos) / delta_time;
+            }
+        }
+        self.last = Some((input.pos, input.time));
+    }
+}
+
+#[test]
+fn spike_filter_plausibility() {
+    let mut filter = SpikeFilter::new(1000.0);
+    // nothing to compare to
+    assert!(filter.is_plausible(&ModelerInput {
+        pos: (100.0, 100.0),
+        time: 0.01,
+        ..ModelerInput::default()
+    }));
+
+    filter.accept(&ModelerInput::default());
+    filter.accept(&ModelerInput {
+        pos: (0.1, 0.0),
+        time: 0.01,
+        ..ModelerInput::default()
+    });
+    // steady speed of 10
+    assert!(filter.is_plausible(&ModelerInput {
+        pos: (0.2, 0.0),
+        time: 0.02,
+        ..ModelerInput::default()
+    }));
+    // speed of 1000, acceleration of ~ 1e5
+    assert!(!filter.is_plausible(&ModelerInput {
+        pos: (10.1, 0.0),
+        time: 0.02,
+        ..ModelerInput::default()
+    }));
+    // same time, can't be checked
+    assert!(filter.is_plausible(&ModelerInput {
+        pos: (10.1, 0.0),
+        time: 0.01,
+        ..ModelerInput::default()
+    }));
+
+    filter.reset();
+    assert!(filter.is_plausible(&ModelerInput {
+        pos: (10.1, 0.0),
+        time: 0.02,
+        ..ModelerInput::default()
+    }));
+}
@@ -1,6 +1,9 @@
-use crate::utils::{dist, interp, interp2, nearest_point_on_segment};
+use crate::kernels::Kernels;
+use crate::ring_buffer::RingBuffer;
+use crate::utils::{dist, interp};
 use crate::ModelerInput;
-use std::collections::VecDeque;
+use allocator_api2::alloc::{Allocator, Global};
+use allocator_api2::vec::Vec;
 
 // only imported for docstrings
 #[allow(unused)]
@@ -16,51 +19,196 @@ use crate::ModelerResult;
 /// pressure data by calling this struct with the `query` function
 #[doc = include_str!("../docs/notations.html")]
 #[doc = include_str!("../docs/stylus_state_modeler.html")]
-pub(crate) struct StateModeler {
+pub(crate) struct StateModeler<A: Allocator + Clone = Global> {
     /// max number of elements
     stylus_state_modeler_max_input_samples: usize,
+    /// time and arc length horizons of the elements, if any
+    max_input_duration: Option<f64>,
+    max_input_distance: Option<f64>,
     /// deque holding the data from strokes
-    last_strokes: VecDeque<ModelerInput>,
+    last_strokes: RingBuffer<ModelerInput, A>,
+    /// arc length of `last_strokes`
+    arc_length: f64,
+    /// positions of `last_strokes`, contiguous for the segment search kernel
+    pub(crate) xs: Vec<f64, A>,
+    ys: Vec<f64, A>,
+    /// scratch buffers of the segment search kernel
+    ratios: Vec<f64, A>,
+    distances: Vec<f64, A>,
+    kernels: Kernels,
 }
 
 impl Default for StateModeler {
     fn default() -> Self {
-        Self {
-            stylus_state_modeler_max_input_samples: 10,
-            last_strokes: VecDeque::with_capacity(11),
-        }
+        Self::new(10)
     }
 }
 
 impl StateModeler {
     /// initialize a new StateModeler
     pub(crate) fn new(param: usize) -> Self {
+        Self::new_in(param, Global)
+    }
+}
+
+impl<A: Allocator + Clone> StateModeler<A> {
+    /// initialize a new StateModeler, with its buffer allocated in `alloc`
+    pub(crate) fn new_in(param: usize, alloc: A) -> Self {
         // zero is not a valid parameter, we put 1 in that case
         // to prevent errors
-        if param == 0 {
-            return Self {
-                stylus_state_modeler_max_input_samples: 1,
-                last_strokes: VecDeque::with_capacity(2),
-            };
-        }
+        let param = param.max(1);
         Self {
             stylus_state_modeler_max_input_samples: param,
-            last_strokes: VecDeque::with_capacity(param + 1),
+            max_input_duration: None,
+            max_input_distance: None,
+            last_strokes: RingBuffer::with_capacity_in(param + 1, alloc.clone()),
+            arc_length: 0.0,
+            xs: Vec::with_capacity_in(param + 1, alloc.clone()),
+            ys: Vec::with_capacity_in(param + 1, alloc.clone()),
+            ratios: Vec::with_capacity_in(param, alloc.clone()),
+            distances: Vec::with_capacity_in(param, alloc),
+            kernels: Kernels::detect(),
         }
     }
 
+    pub(crate) fn kernels(&self) -> Kernels {
+        self.kernels
+    }
+
+    pub(crate) fn set_kernels(&mut self, kernels: Kernels) {
+        self.kernels = kernels;
+    }
+
+    /// set the time and arc length horizons of the raw inputs, on top of the count limit
+    pub(crate) fn set_horizon(&mut self, max_duration: Option<f64>, max_distance: Option<f64>) {
+        self.max_input_duration = max_duration;
+        self.max_input_distance = max_distance;
+    }
+
     /// add the most recent raw input to the StateModeler
     pub(crate) fn update(&mut self, input: ModelerInput) {
+        self.update_behind(input, None);
+    }
+
+    /// add the most recent raw input, `modeled` being the current positions of the
+    /// position modelers that query the pressures. The horizons are counted back from
+    /// the raw input nearest to the most lagging of them (from the latest input if none),
+    /// so that they only add a margin to the lag of the modeled positions
+    pub(crate) fn update_behind(
+        &mut self,
+        input: ModelerInput,
+        modeled: impl IntoIterator<Item = (f64, f64)>,
+    ) {
         // add the event to the strokes
+        if let Some(last) = self.last_strokes.back() {
+            self.arc_length += dist(last.pos, input.pos);
+        }
         self.last_strokes.push_back(input);
-        if self.last_strokes.len() > self.stylus_state_modeler_max_input_samples {
-            self.last_strokes.pop_front();
+        while self.last_strokes.len() > self.stylus_state_modeler_max_input_samples {
+            self.pop_front();
+        }
+        self.copy_positions();
+        if self.max_input_duration.is_some() || self.max_input_distance.is_some() {
+            let mut anchor = self.anchor(modeled);
+            let mut dropped = false;
+            while self.beyond_horizon(anchor) {
+                anchor.1 -= self.pop_front();
+                dropped = true;
+            }
+            if dropped {
+                self.copy_positions();
+            }
+        }
+    }
+
+    /// drop the oldest input, returns the length of the segment removed
+    fn pop_front(&mut self) -> f64 {
+        let front = self.last_strokes.pop_front().unwrap();
+        match self.last_strokes.front() {
+            Some(next) => {
+                let length = dist(front.pos, next.pos);
+                self.arc_length -= length;
+                length
+            }
+            None => 0.0,
+        }
+    }
+
+    /// copy the positions of `last_strokes` to the buffers of the segment search kernel
+    fn copy_positions(&mut self) {
+        self.xs.clear();
+        self.ys.clear();
+        for input in self.last_strokes.iter() {
+            self.xs.push(input.pos.0);
+            self.ys.push(input.pos.1);
         }
+        let n_segments = self.last_strokes.len().saturating_sub(1);
+        self.ratios.resize(n_segments, 0.0);
+        self.distances.resize(n_segments, 0.0);
+    }
+
+    /// time and arc length (from the oldest input) of the point of the raw inputs nearest
+    /// to the most lagging of the `modeled` positions, or of the latest input
+    fn anchor(&mut self, modeled: impl IntoIterator<Item = (f64, f64)>) -> (f64, f64) {
+        let mut anchor = match self.last_strokes.back() {
+            Some(latest) => (latest.time, self.arc_length),
+            None => return (0.0, 0.0),
+        };
+        if self.last_strokes.len() < 2 {
+            return anchor;
+        }
+        for pos in modeled {
+            let (index, ratio) = self.kernels.nearest_segment(
+                (&self.xs, &self.ys),
+                pos,
+                &mut self.ratios,
+                &mut self.distances,
+            );
+            let start = self.last_strokes.get(index).unwrap();
+            let end = self.last_strokes.get(index + 1).unwrap();
+            let time = interp(start.time, end.time, ratio);
+            if time < anchor.0 {
+                let arc_length = (0..index)
+                    .map(|i| {
+                        dist(
+                            self.last_strokes.get(i).unwrap().pos,
+                            self.last_strokes.get(i + 1).unwrap().pos,
+                        )
+                    })
+                    .sum::<f64>()
+                    + ratio * dist(start.pos, end.pos);
+                anchor = (time, arc_length);
+            }
+        }
+        anchor
+    }
+
+    /// whether the first segment of the deque is entirely outside of the horizons behind
+    /// the `anchor` (time and arc length from the oldest input), so that the oldest input
+    /// can be dropped. The last segment is always kept
+    fn beyond_horizon(&self, anchor: (f64, f64)) -> bool {
+        if self.last_strokes.len() <= 2 {
+            return false;
+        }
+        let (front, next) = (
+            self.last_strokes.front().unwrap(),
+            self.last_strokes.get(1).unwrap(),
+        );
+        self.max_input_duration
+            .map_or(false, |max_duration| anchor.0 - next.time > max_duration)
+            || self.max_input_distance.map_or(false, |max_distance| {
+                anchor.1 - dist(front.pos, next.pos) > max_distance
+            })
     }
 
     /// reset the StateModeler
     pub(crate) fn reset(&mut self, max_input: usize) {
         self.last_strokes.clear();
+        self.arc_length = 0.0;
+        self.xs.clear();
+        self.ys.clear();
+        self.ratios.clear();
+        self.distances.clear();
         self.stylus_state_modeler_max_input_samples = max_input;
     }
 
@@ -71,28 +219,17 @@ impl StateModeler {
             0 => 1.0,
             1 => self.last_strokes.front().unwrap().pressure,
             _ => {
-                let mut distance = f64::INFINITY;
-                let mut r: f64 = 0.0;
-
-                let mut start_pressure: f64 = 1.0;
-                let mut end_pressure: f64 = 1.0;
-
-                for index_it in 0..self.last_strokes.len() - 1 {
-                    let start_pos = self.last_strokes.get(index_it).unwrap().pos;
-                    let end_pos = self.last_strokes.get(index_it + 1).unwrap().pos;
-
-                    let r_c = nearest_point_on_segment(start_pos, end_pos, pos);
-                    let point_c = interp2(start_pos, end_pos, r_c);
-
-                    if dist(pos, point_c) < distance {
-                        distance = dist(pos, point_c);
-                        r = r_c;
-                        start_pressure = self.last_strokes.get(index_it).unwrap().pressure;
-                        end_pressure = self.last_strokes.get(index_it + 1).unwrap().pressure;
-                    }
-                }
-
-                interp(start_pressure, end_pressure, r)
+                let (index, ratio) = self.kernels.nearest_segment(
+                    (&self.xs, &self.ys),
+                    pos,
+                    &mut self.ratios,
+                    &mut self.distances,
+                );
+                interp(
+                    self.last_strokes.get(index).unwrap().pressure,
+                    self.last_strokes.get(index + 1).unwrap().pressure,
+                    ratio,
+                )
             }
         }
     }
@@ -234,6 +371,49 @@ fn query_stale() {
     approx::assert_abs_diff_eq!(state_mod.query((-3.0, 17. / 6.)), 0.9, epsilon = tol);
 }
 
+#[test]
+fn horizons() {
+    // inputs 1 apart, every 0.5 time unit
+    let inputs = (0..200).map(|i| ModelerInput {
+        pos: (i as f64, 0.0),
+        time: 0.5 * i as f64,
+        pressure: (i % 2) as f64,
+        ..Default::default()
+    });
+    let mut by_time = StateModeler::new(100);
+    by_time.set_horizon(Some(10.0), None);
+    let mut by_distance = StateModeler::new(100);
+    by_distance.set_horizon(None, Some(10.0));
+    let mut by_count = StateModeler::new(100);
+    by_count.set_horizon(Some(1000.0), Some(1000.0));
+    for input in inputs {
+        by_time.update(input.clone());
+        by_distance.update(input.clone());
+        by_count.update(input);
+    }
+    assert_eq!(by_time.last_strokes.len(), 22);
+    assert_eq!(by_distance.last_strokes.len(), 12);
+    approx::assert_abs_diff_eq!(by_distance.arc_length, 11.0, epsilon = 1e-9);
+    assert_eq!(by_count.last_strokes.len(), 100);
+    // inside the horizon, the same pressure
+    approx::assert_abs_diff_eq!(by_time.query((195.25, 1.0)), 0.75, epsilon = 1e-9);
+    approx::assert_abs_diff_eq!(by_distance.query((195.25, 1.0)), 0.75, epsilon = 1e-9);
+    // outside, the oldest kept segment
+    approx::assert_abs_diff_eq!(by_distance.query((150.0, 1.0)), 0.0, epsilon = 1e-9);
+
+    // the last segment is always kept
+    let mut state_mod = StateModeler::new(10);
+    state_mod.set_horizon(Some(0.001), Some(0.001));
+    state_mod.update(ModelerInput::default());
+    state_mod.update(ModelerInput {
+        pos: (5.0, 0.0),
+        time: 1.0,
+        pressure: 0.5,
+        ..Default::default()
+    });
+    approx::assert_abs_diff_eq!(state_mod.query((2.5, 0.0)), 0.75, epsilon = 1e-9);
+}
+
 #[test]
 fn query_reset() {
     let mut state_mod = StateModeler::default();
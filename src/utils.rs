@@ -34,6 +34,7 @@ where
 }
 
 /// interpolation (with the `interp_amount` clamped between 0 and 1) for `(f64,f64)` types
+#[inline]
 pub(crate) fn interp2(start: (f64, f64), end: (f64, f64), interp_amount: f64) -> (f64, f64) {
     (
         start.0 + interp_amount.clamp(0.0, 1.0) * (end.0 - start.0),
@@ -44,6 +45,7 @@ pub(crate) fn interp2(start: (f64, f64), end: (f64, f64), interp_amount: f64) ->
 /// returns the point on the line segment from `segment_start` to `segment_end`
 /// that is closest to `point`, represented as the ratio of the length
 /// along the segment
+#[inline]
 pub(crate) fn nearest_point_on_segment(
     start: (f64, f64),
     end: (f64, f64),
@@ -60,15 +62,50 @@ pub(crate) fn nearest_point_on_segment(
 }
 
 /// dot product for `(f46,f64)` types
+#[inline]
 pub(crate) fn dot(x: (f64, f64), y: (f64, f64)) -> f64 {
     x.0 * y.0 + x.1 * y.1
 }
 
 /// distance calculation for `(f64,f64)` types
+#[inline]
 pub fn dist(start: (f64, f64), end: (f64, f64)) -> f64 {
     ((start.0 - end.0).powi(2) + (start.1 - end.1).powi(2)).sqrt()
 }
 
+/// test clock, each call advances it by 1 ms
+#[cfg(test)]
+pub(crate) fn ticking_clock() -> impl FnMut() -> std::time::Duration {
+    let mut now = std::time::Duration::ZERO;
+    move || {
+        now += std::time::Duration::from_millis(1);
+        now
+    }
+}
+
+/// test stroke of `n_inputs` inputs sampled at 240 Hz from `start_time`, from a `Down`
+/// to an `Up`, the position of the input `i` being `pos(i)`
+#[cfg(test)]
+pub(crate) fn test_stroke(
+    n_inputs: usize,
+    start_time: f64,
+    mut pos: impl FnMut(usize) -> (f64, f64),
+) -> Vec<crate::ModelerInput> {
+    use crate::ModelerInputEventType;
+    (0..n_inputs)
+        .map(|i| crate::ModelerInput {
+            event_type: match i {
+                0 => ModelerInputEventType::Down,
+                _ if i == n_inputs - 1 => ModelerInputEventType::Up,
+                _ => ModelerInputEventType::Move,
+            },
+            pos: pos(i),
+            time: start_time + i as f64 / 240.0,
+            pressure: 0.5,
+        })
+        .collect()
+}
+
 #[cfg(test)]
 mod test_utils {
     use crate::utils::{interp, interp2, nearest_point_on_segment, normalize01_64};